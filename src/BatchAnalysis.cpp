@@ -0,0 +1,297 @@
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "BatchAnalysis.hpp"
+#include "CommandLine.hpp"
+#include "MotionDetection.hpp"
+#include "VideoSource.hpp"
+#include "WorkerPool.hpp"
+
+// What came out of analyzing one recording.
+//
+struct BatchResult {
+    std::string file;
+    std::string error;                 // "" on success
+    uint64_t frames;
+    uint64_t analyzedFrames;
+    double mediaSeconds;
+    double wallSeconds;
+    double rateSum;                    // over the analyzed frames
+    double finalRate;
+    unsigned alarms;
+
+    BatchResult()
+        : file(), error(), frames(0), analyzedFrames(0), mediaSeconds(0.0)
+        , wallSeconds(0.0), rateSum(0.0), finalRate(0.0), alarms(0)
+    {}
+};
+
+static std::string
+csvQuote(const std::string &field)
+{
+    if (field.find_first_of(",\"\n") == std::string::npos)
+        return field;
+    std::string result = "\"";
+    for (char c : field) {
+        if (c == '"')
+            result += '"';
+        result += c;
+    }
+    return result + "\"";
+}
+
+static std::string
+baseName(const std::string &path)
+{
+    const std::string::size_type n = path.rfind("/");
+    return n == std::string::npos ? path : path.substr(n + 1);
+}
+
+// Return the recordings in directory path, or listed in the manifest at
+// path. Manifest lines are file names relative to the manifest, and lines
+// starting with '#' are comments.
+//
+static std::vector<std::string>
+listRecordings(const std::string &path)
+{
+    std::vector<std::string> result;
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0)
+        throw std::system_error(errno, std::system_category(), "Cannot read " + path);
+
+    if (S_ISDIR(st.st_mode)) {
+        DIR *dir = opendir(path.c_str());
+        if (dir == nullptr)
+            throw std::system_error(errno, std::system_category(), "Cannot read " + path);
+        while (struct dirent *entry = readdir(dir)) {
+            const std::string name = entry->d_name;
+            if (name.empty() || name[0] == '.')
+                continue;
+            if (name.size() > 4 && name.compare(name.size() - 4, 4, ".csv") == 0)
+                continue;
+            const std::string file = path + "/" + name;
+            struct stat fst;
+            if (stat(file.c_str(), &fst) == 0 && S_ISREG(fst.st_mode))
+                result.push_back(file);
+        }
+        closedir(dir);
+        std::sort(result.begin(), result.end());
+    } else {
+        const std::string::size_type n = path.rfind("/");
+        const std::string base = n == std::string::npos ? "" : path.substr(0, n + 1);
+        std::ifstream manifest(path);
+        std::string line;
+        while (std::getline(manifest, line)) {
+            const std::string::size_type first = line.find_first_not_of(" \t\r");
+            if (first == std::string::npos || line[first] == '#')
+                continue;
+            const std::string::size_type last = line.find_last_not_of(" \t\r");
+            const std::string file = line.substr(first, last - first + 1);
+            result.push_back(file[0] == '/' ? file : base + file);
+        }
+    }
+    return result;
+}
+
+// Runs on the pool: analyze file with a detector of its own, writing one
+// line per frame to csvPath.
+//
+static BatchResult
+analyzeRecording(const CommandLine *cl, std::string file, std::string csvPath)
+{
+    BatchResult result;
+    result.file = file;
+    const auto start = std::chrono::steady_clock::now();
+    try {
+        VideoSource source(-1, file, cl->input_fps, cl->frameWidth, cl->frameHeight, cl->inFormat);
+        MotionDetection detector(*cl, BATCH_DETECTOR);
+
+        std::unique_ptr<FILE, int (*)(FILE *)> csv(fopen(csvPath.c_str(), "w"), fclose);
+        if (!csv)
+            throw std::system_error(errno, std::system_category(), "Cannot write " + csvPath);
+        fprintf(csv.get(), "timestamp_ms,analyzed,motion,breathing_rate_hz,rate_confidence,alarm");
+        for (size_t b = 0; b < detector.getBandCount(); b++) {
+            fprintf(csv.get(), ",band_%g_%g_mrad", cl->extraBands[b].first, cl->extraBands[b].second);
+        }
+        fprintf(csv.get(), "\n");
+
+        uint64_t first = 0;
+        for (;;) {
+            cv::Mat frame; uint64_t timestamp = 0;
+            const bool more = source.read(frame, timestamp);
+            if (frame.empty()) {
+                if (!more)
+                    break;
+                continue;
+            }
+            if (result.frames == 0)
+                first = timestamp;
+            detector.update(frame, timestamp);
+
+            result.frames++;
+            result.mediaSeconds = (timestamp - first) / 1e6;
+            if (detector.wasAnalyzed()) {
+                result.analyzedFrames++;
+                result.rateSum += detector.getBreathingRate();
+            }
+            fprintf(csv.get(), "%.3f,%d,%u,%f,%.3f,%d", timestamp / 1000.0,
+                    detector.wasAnalyzed(), detector.getMotion(),
+                    detector.getBreathingRate(), detector.getRateConfidence(),
+                    detector.isAlarming());
+            for (size_t b = 0; b < detector.getBandCount(); b++) {
+                fprintf(csv.get(), ",%.3f", detector.getBandMotion(b));
+            }
+            fprintf(csv.get(), "\n");
+        }
+        csv.reset();
+
+        result.finalRate = detector.getBreathingRate();
+        result.alarms = detector.getAlarmCount();
+    } catch (const std::exception &e) {
+        result.error = e.what();
+    }
+    const std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+    result.wallSeconds = wall.count();
+    return result;
+}
+
+// Return the name for the time series of file, the i'th recording, that
+// is not in names yet, and add it there.
+//
+static std::string
+seriesName(const std::string &file, size_t i, std::set<std::string> &names)
+{
+    std::string name = baseName(file);
+    const std::string::size_type dot = name.rfind(".");
+    if (dot != std::string::npos && dot > 0)
+        name = name.substr(0, dot);
+    if (!names.insert(name).second)
+        name += "-" + std::to_string(i);
+    return name;
+}
+
+int analyzeBatch(const CommandLine &cl)
+{
+    const std::vector<std::string> files = listRecordings(cl.batchPath);
+    if (files.empty()) {
+        fprintf(stderr, "[error] No recordings found in %s\n", cl.batchPath.c_str());
+        return 1;
+    }
+    if (mkdir(cl.batchOutput.c_str(), 0755) < 0 && errno != EEXIST)
+        throw std::system_error(errno, std::system_category(), "Cannot create " + cl.batchOutput);
+
+    WorkerPool pool(cl.jobs);
+    printf("[info] Analyzing %zu recordings on %u threads.\n", files.size(), pool.size());
+
+    // Name each time series after its recording, telling apart recordings
+    // from different directories with the same name.
+    std::set<std::string> names;
+    std::vector<std::future<BatchResult>> results;
+    for (size_t i = 0; i < files.size(); i++) {
+        const std::string name = seriesName(files[i], i, names);
+        const std::string csvPath = cl.batchOutput + "/" + name + ".csv";
+        results.push_back(pool.push(analyzeRecording, &cl, files[i], csvPath));
+    }
+
+    const std::string summaryPath = cl.batchOutput + "/summary.csv";
+    std::ofstream summary(summaryPath);
+    if (!summary)
+        throw std::runtime_error("Cannot write " + summaryPath);
+    summary << "file,frames,analyzed_frames,media_seconds,wall_seconds,"
+            << "frames_per_second,mean_breathing_rate_hz,final_breathing_rate_hz,"
+            << "alarm_events,error\n";
+
+    int status = 0;
+    for (auto &future : results) {
+        const BatchResult r = future.get();
+        const double fps = r.wallSeconds > 0 ? r.frames / r.wallSeconds : 0.0;
+        const double meanRate = r.analyzedFrames ? r.rateSum / r.analyzedFrames : 0.0;
+        summary << csvQuote(r.file) << ',' << r.frames << ',' << r.analyzedFrames << ','
+                << r.mediaSeconds << ',' << r.wallSeconds << ',' << fps << ','
+                << meanRate << ',' << r.finalRate << ',' << r.alarms << ','
+                << csvQuote(r.error) << '\n';
+        if (r.error.empty()) {
+            printf("[info] %s: %" PRIu64 " frames in %.1f s (%.1f fps), %f Hz, %u alarms\n",
+                   r.file.c_str(), r.frames, r.wallSeconds, fps, meanRate, r.alarms);
+        } else {
+            fprintf(stderr, "[error] %s: %s\n", r.file.c_str(), r.error.c_str());
+            status = 1;
+        }
+    }
+    return status;
+}
+
+int benchmarkEngines(const CommandLine &cl)
+{
+    static const char *const engines[] = { "riesz", "linear" };
+
+    std::vector<std::string> files;
+    if (!cl.batchPath.empty())
+        files = listRecordings(cl.batchPath);
+    else if (!cl.inFile.empty())
+        files.push_back(cl.inFile);
+    if (files.empty()) {
+        fprintf(stderr, "[error] Nothing to benchmark: no recordings, and a camera cannot be replayed.\n");
+        return 1;
+    }
+    if (mkdir(cl.batchOutput.c_str(), 0755) < 0 && errno != EEXIST)
+        throw std::system_error(errno, std::system_category(), "Cannot create " + cl.batchOutput);
+
+    const std::string benchmarkPath = cl.batchOutput + "/benchmark.csv";
+    std::ofstream benchmark(benchmarkPath);
+    if (!benchmark)
+        throw std::runtime_error("Cannot write " + benchmarkPath);
+    benchmark << "file,engine,frames,analyzed_frames,wall_seconds,frames_per_second,"
+              << "speedup,mean_breathing_rate_hz,rate_difference_hz,"
+              << "alarm_events,alarm_difference,error\n";
+
+    int status = 0;
+    std::set<std::string> names;
+    for (size_t i = 0; i < files.size(); i++) {
+        const std::string name = seriesName(files[i], i, names);
+        BatchResult reference;
+        for (const char *engine : engines) {
+            CommandLine config(cl);
+            config.magnifier = engine;
+            const std::string csvPath = cl.batchOutput + "/" + name + "-" + engine + ".csv";
+            const BatchResult r = analyzeRecording(&config, files[i], csvPath);
+            if (engine == engines[0])
+                reference = r;
+
+            const double fps = r.wallSeconds > 0 ? r.frames / r.wallSeconds : 0.0;
+            const double speedup = r.wallSeconds > 0 ? reference.wallSeconds / r.wallSeconds : 0.0;
+            const double meanRate = r.analyzedFrames ? r.rateSum / r.analyzedFrames : 0.0;
+            const double referenceRate
+                = reference.analyzedFrames ? reference.rateSum / reference.analyzedFrames : 0.0;
+            benchmark << csvQuote(r.file) << ',' << engine << ',' << r.frames << ','
+                      << r.analyzedFrames << ',' << r.wallSeconds << ',' << fps << ','
+                      << speedup << ',' << meanRate << ',' << meanRate - referenceRate << ','
+                      << r.alarms << ',' << (int)r.alarms - (int)reference.alarms << ','
+                      << csvQuote(r.error) << '\n';
+            if (r.error.empty()) {
+                printf("[info] %s, %s: %.1f fps (x%.2f), %f Hz (%+f), %u alarms\n",
+                       r.file.c_str(), engine, fps, speedup, meanRate,
+                       meanRate - referenceRate, r.alarms);
+            } else {
+                fprintf(stderr, "[error] %s, %s: %s\n", r.file.c_str(), engine, r.error.c_str());
+                status = 1;
+            }
+        }
+    }
+    return status;
+}
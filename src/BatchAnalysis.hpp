@@ -0,0 +1,22 @@
+#ifndef BATCH_ANALYSIS_H_INCLUDED
+#define BATCH_ANALYSIS_H_INCLUDED
+
+struct CommandLine;
+
+// Analyze every recording named by cl.batchPath, which is a directory or
+// a manifest listing one file per line, each with its own
+// MotionDetection, on a pool of cl.jobs threads. Writes a time series
+// per recording and summary.csv into cl.batchOutput.
+// Return 0 if every recording was analyzed or 1 otherwise.
+//
+int analyzeBatch(const CommandLine &cl);
+
+// Analyze the input of cl, or every recording named by cl.batchPath, once
+// with each magnification engine, one recording at a time on this thread
+// so their costs compare. Writes a time series per recording and engine
+// and benchmark.csv, comparing each engine to the riesz engine, into
+// cl.batchOutput. Return 0 if every recording was analyzed or 1 otherwise.
+//
+int benchmarkEngines(const CommandLine &cl);
+
+#endif // #ifndef BATCH_ANALYSIS_H_INCLUDED
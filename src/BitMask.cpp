@@ -0,0 +1,359 @@
+#include <assert.h>
+
+#include <algorithm>
+
+#include "BitMask.hpp"
+
+// Return the bits of the last word of a row that are past the last column.
+//
+static inline uint64_t
+paddingBits(int cols)
+{
+    return (cols & 63) ? ~0ull << (cols & 63) : 0;
+}
+
+// Set the m words of dst so that bit x of dst is bit x + d of the n words
+// of src, where bits outside of src are fill.
+//
+static void
+shiftRow(const uint64_t *src, int n, uint64_t *dst, int m, int d, uint64_t fill)
+{
+    const int q = (d >= 0 ? d : -d) >> 6;
+    const int r = (d >= 0 ? d : -d) & 63;
+    for (int w = 0; w < m; w++) {
+        uint64_t word;
+        if (d >= 0) {
+            const uint64_t lo = w + q < n ? src[w + q] : fill;
+            const uint64_t hi = w + q + 1 < n ? src[w + q + 1] : fill;
+            word = r ? (lo >> r) | (hi << (64 - r)) : lo;
+        } else {
+            const uint64_t hi = w - q >= 0 && w - q < n ? src[w - q] : fill;
+            const uint64_t lo = w - q - 1 >= 0 && w - q - 1 < n ? src[w - q - 1] : fill;
+            word = r ? (hi << r) | (lo >> (64 - r)) : hi;
+        }
+        dst[w] = word;
+    }
+}
+
+void
+BitMask::create(int rows, int cols)
+{
+    itsRows = rows;
+    itsCols = cols;
+    itsWords = (cols + 63) / 64;
+    itsBits.assign((size_t)rows * itsWords, 0);
+}
+
+void
+BitMask::clear()
+{
+    std::fill(itsBits.begin(), itsBits.end(), 0);
+}
+
+void
+BitMask::setRow(int y, const uchar *bytes)
+{
+    uint64_t *words = row(y);
+    for (int w = 0; w < itsWords; w++) {
+        const uchar *from = bytes + w * 64;
+        const int n = std::min(64, itsCols - w * 64);
+        uint64_t word = 0;
+        for (int b = 0; b < n; b++) {
+            word |= (uint64_t)(from[b] != 0) << b;
+        }
+        words[w] = word;
+    }
+}
+
+BitMask &
+BitMask::operator|=(const BitMask &other)
+{
+    assert(other.itsRows == itsRows && other.itsCols == itsCols);
+    const uint64_t *from = other.itsBits.data();
+    uint64_t *to = itsBits.data();
+    const size_t n = itsBits.size();
+    for (size_t i = 0; i < n; i++) {
+        to[i] |= from[i];
+    }
+    return *this;
+}
+
+BitMask &
+BitMask::operator&=(const BitMask &other)
+{
+    assert(other.itsRows == itsRows && other.itsCols == itsCols);
+    const uint64_t *from = other.itsBits.data();
+    uint64_t *to = itsBits.data();
+    const size_t n = itsBits.size();
+    for (size_t i = 0; i < n; i++) {
+        to[i] &= from[i];
+    }
+    return *this;
+}
+
+unsigned
+BitMask::count() const
+{
+    unsigned result = 0;
+    for (uint64_t word : itsBits) {
+        result += __builtin_popcountll(word);
+    }
+    return result;
+}
+
+unsigned
+BitMask::count(int y, int begin, int end) const
+{
+    if (begin >= end) {
+        return 0;
+    }
+    const uint64_t *words = row(y);
+    const int first = begin >> 6, last = (end - 1) >> 6;
+    const uint64_t head = ~0ull << (begin & 63);
+    const uint64_t tail = ~0ull >> (63 - ((end - 1) & 63));
+    if (first == last) {
+        return __builtin_popcountll(words[first] & head & tail);
+    }
+    unsigned result = __builtin_popcountll(words[first] & head);
+    for (int w = first + 1; w < last; w++) {
+        result += __builtin_popcountll(words[w]);
+    }
+    return result + __builtin_popcountll(words[last] & tail);
+}
+
+// Bit k of the index of each bit of a word is set in the bits of
+// POSITION_BITS[k], so the sum of the indexes of the bits set in a word w
+// is the sum over k of popcount(w & POSITION_BITS[k]) << k.
+//
+static const uint64_t POSITION_BITS[6] = {
+    0xaaaaaaaaaaaaaaaaull, 0xccccccccccccccccull, 0xf0f0f0f0f0f0f0f0ull,
+    0xff00ff00ff00ff00ull, 0xffff0000ffff0000ull, 0xffffffff00000000ull
+};
+
+BitMaskMoments
+BitMask::moments() const
+{
+    BitMaskMoments result;
+    for (int y = 0; y < itsRows; y++) {
+        const uint64_t *words = row(y);
+        uint64_t n = 0, sumX = 0;
+        for (int w = 0; w < itsWords; w++) {
+            const uint64_t word = words[w];
+            if (word == 0) {
+                continue;
+            }
+            const uint64_t bits = __builtin_popcountll(word);
+            n += bits;
+            sumX += bits * 64 * w;
+            for (int k = 0; k < 6; k++) {
+                sumX += (uint64_t)__builtin_popcountll(word & POSITION_BITS[k]) << k;
+            }
+        }
+        result.m00 += n;
+        result.m10 += sumX;
+        result.m01 += n * y;
+    }
+    return result;
+}
+
+template<bool erode> static inline void
+combine(uint64_t *into, const uint64_t *a, const uint64_t *b, int n)
+{
+    for (int w = 0; w < n; w++) {
+        into[w] = erode ? a[w] & b[w] : a[w] | b[w];
+    }
+}
+
+// A size x size rectangle with its anchor at (size / 2, size / 2), as
+// OpenCV has it, covers offsets -size / 2 to size - 1 - size / 2. It is
+// separable, so run it along the rows and then down the columns. Pixels
+// outside of the mask are set for erode and clear for dilate, so they
+// never change the result.
+//
+// Along a row, combining the row with itself shifted by 1, 2, 4 ... bits
+// doubles the span covered each time, so a row takes log2(size) shifts.
+// Down the columns, van Herk/Gil-Werman: cut the rows into blocks of size,
+// and any window of size rows is the suffix of one block combined with
+// the prefix of the next, for 3 operations per word whatever the size.
+//
+template<bool erode> void
+BitMask::morph(int size)
+{
+    if (size <= 1 || empty()) {
+        return;
+    }
+    const int first = -(size / 2);
+    const uint64_t fill = erode ? ~0ull : 0;
+    const uint64_t padding = paddingBits(itsCols);
+    const int wide = (itsCols + size + 63) / 64;
+    std::vector<uint64_t> span(wide), shifted(wide);
+
+    for (int y = 0; y < itsRows; y++) {
+        uint64_t *words = row(y);
+        if (erode) {
+            words[itsWords - 1] |= padding;
+        }
+        // Pixel x of span combines pixels x + first to x + first + covered
+        // - 1 of the row, so span needs size - 1 more pixels than the row.
+        shiftRow(words, itsWords, span.data(), wide, first, fill);
+        int covered = 1;
+        while (covered < size) {
+            const int step = std::min(covered, size - covered);
+            shiftRow(span.data(), wide, shifted.data(), wide, step, fill);
+            combine<erode>(span.data(), span.data(), shifted.data(), wide);
+            covered += step;
+        }
+        std::copy(span.begin(), span.begin() + itsWords, words);
+        words[itsWords - 1] &= ~padding;
+    }
+
+    // Padded row p is row p + first, or fill outside of the mask.
+    const int padded = itsRows + size - 1;
+    const std::vector<uint64_t> fillRow(itsWords, fill);
+    std::vector<uint64_t> prefix((size_t)padded * itsWords), suffix((size_t)padded * itsWords);
+    auto source = [&](int p) {
+        const int y = p + first;
+        return y >= 0 && y < itsRows ? row(y) : fillRow.data();
+    };
+    for (int p = 0; p < padded; p++) {
+        uint64_t *into = prefix.data() + (size_t)p * itsWords;
+        if (p % size == 0) {
+            std::copy(source(p), source(p) + itsWords, into);
+        } else {
+            combine<erode>(into, into - itsWords, source(p), itsWords);
+        }
+    }
+    for (int p = padded - 1; p >= 0; p--) {
+        uint64_t *into = suffix.data() + (size_t)p * itsWords;
+        if (p % size == size - 1 || p == padded - 1) {
+            std::copy(source(p), source(p) + itsWords, into);
+        } else {
+            combine<erode>(into, into + itsWords, source(p), itsWords);
+        }
+    }
+    for (int y = 0; y < itsRows; y++) {
+        combine<erode>(row(y), suffix.data() + (size_t)y * itsWords,
+                       prefix.data() + (size_t)(y + size - 1) * itsWords, itsWords);
+    }
+}
+
+void
+BitMask::erode(int size)
+{
+    morph<true>(size);
+}
+
+void
+BitMask::dilate(int size)
+{
+    morph<false>(size);
+}
+
+// A run of set pixels [begin, end) in one row, and the run it was found
+// to be connected to, which leads eventually to the root of its component.
+//
+struct BitRun {
+    int y, begin, end;
+    unsigned parent;
+};
+
+static unsigned
+findRoot(std::vector<BitRun> &runs, unsigned i)
+{
+    while (runs[i].parent != i) {
+        runs[i].parent = runs[runs[i].parent].parent;
+        i = runs[i].parent;
+    }
+    return i;
+}
+
+// Return the first pixel at or after x in the n words of bits that is set,
+// or clear if invert, or 64 * n if there is none.
+//
+static int
+nextBit(const uint64_t *bits, int n, int x, bool invert)
+{
+    int w = x >> 6;
+    if (w >= n) {
+        return 64 * n;
+    }
+    uint64_t word = (invert ? ~bits[w] : bits[w]) & (~0ull << (x & 63));
+    while (word == 0) {
+        if (++w == n) {
+            return 64 * n;
+        }
+        word = invert ? ~bits[w] : bits[w];
+    }
+    return 64 * w + __builtin_ctzll(word);
+}
+
+// Label the runs of each row, joining those that touch a run of the row
+// above (diagonals included) with union-find. The runs come straight out
+// of the words, so this does work in proportion to the runs, not pixels.
+//
+std::vector<BitMaskComponent>
+BitMask::components() const
+{
+    std::vector<BitRun> runs;
+    size_t above = 0, aboveEnd = 0;
+    for (int y = 0; y < itsRows; y++) {
+        const uint64_t *words = row(y);
+        const size_t here = runs.size();
+        int x = 0;
+        while ((x = nextBit(words, itsWords, x, false)) < itsCols) {
+            const int end = std::min(nextBit(words, itsWords, x, true), itsCols);
+            const unsigned i = runs.size();
+            runs.push_back(BitRun{y, x, end, i});
+            x = end;
+        }
+        for (size_t i = here, a = above; i < runs.size() && a < aboveEnd;) {
+            if (runs[a].end < runs[i].begin) {
+                a++;
+            } else if (runs[i].end < runs[a].begin) {
+                i++;
+            } else {
+                const unsigned ri = findRoot(runs, i), ra = findRoot(runs, a);
+                if (ri != ra) {
+                    runs[std::max(ri, ra)].parent = std::min(ri, ra);
+                }
+                if (runs[a].end < runs[i].end) {
+                    a++;
+                } else {
+                    i++;
+                }
+            }
+        }
+        above = here;
+        aboveEnd = runs.size();
+    }
+
+    std::vector<BitMaskComponent> result;
+    std::vector<unsigned> label(runs.size());
+    for (unsigned i = 0; i < runs.size(); i++) {
+        const BitRun &run = runs[i];
+        const unsigned root = findRoot(runs, i);
+        if (root == i) {
+            label[i] = result.size();
+            result.push_back(BitMaskComponent{0, cv::Rect(run.begin, run.y, run.end - run.begin, 1)});
+        } else {
+            label[i] = label[root];
+        }
+        BitMaskComponent &c = result[label[i]];
+        c.area += run.end - run.begin;
+        c.bounds |= cv::Rect(run.begin, run.y, run.end - run.begin, 1);
+    }
+    return result;
+}
+
+void
+BitMask::toMat(cv::Mat &into) const
+{
+    into.create(itsRows, itsCols, CV_8UC1);
+    for (int y = 0; y < itsRows; y++) {
+        const uint64_t *words = row(y);
+        uchar *out = into.ptr<uchar>(y);
+        for (int x = 0; x < itsCols; x++) {
+            out[x] = (words[x >> 6] >> (x & 63)) & 1 ? 255 : 0;
+        }
+    }
+}
@@ -0,0 +1,106 @@
+#ifndef BIT_MASK_H_INCLUDED
+#define BIT_MASK_H_INCLUDED
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+// A set of 8-connected pixels in a BitMask.
+//
+struct BitMaskComponent {
+    unsigned area;                     // the number of pixels
+    cv::Rect bounds;
+};
+
+// The number of set pixels in a BitMask and the sums of their x and y,
+// as in cv::Moments, so the centroid is (m10 / m00, m01 / m00).
+//
+struct BitMaskMoments {
+    uint64_t m00, m10, m01;
+
+    BitMaskMoments() : m00(0), m10(0), m01(0) {}
+    BitMaskMoments &operator+=(const BitMaskMoments &other) {
+        m00 += other.m00; m10 += other.m10; m01 += other.m01;
+        return *this;
+    }
+};
+
+// A black and white image packed 1 bit per pixel: pixel x of a row is
+// bit x % 64 of word x / 64 of the row. Bits past the last column are
+// always clear. Logical operations work on 64 pixels at a time, so a
+// mask takes an eighth of the memory and bandwidth of a CV_8UC1 image
+// of 0s and 255s.
+//
+class BitMask {
+    int itsRows, itsCols;
+    int itsWords;                      // per row
+    std::vector<uint64_t> itsBits;
+
+    template<bool erode> void morph(int size);
+
+public:
+
+    BitMask() : itsRows(0), itsCols(0), itsWords(0), itsBits() {}
+    BitMask(int rows, int cols) : BitMask() { create(rows, cols); }
+
+    // Make this rows x cols with every pixel clear.
+    //
+    void create(int rows, int cols);
+
+    // Clear every pixel.
+    //
+    void clear();
+
+    int rows() const { return itsRows; }
+    int cols() const { return itsCols; }
+    int wordsPerRow() const { return itsWords; }
+    bool empty() const { return itsBits.empty(); }
+
+    uint64_t *row(int y) { return itsBits.data() + (size_t)y * itsWords; }
+    const uint64_t *row(int y) const { return itsBits.data() + (size_t)y * itsWords; }
+
+    bool get(int y, int x) const { return (row(y)[x >> 6] >> (x & 63)) & 1; }
+
+    // Set row y from cols() bytes, each setting its pixel if not 0.
+    //
+    void setRow(int y, const uchar *bytes);
+
+    // Combine with other, which must be the same size.
+    //
+    BitMask &operator|=(const BitMask &other);
+    BitMask &operator&=(const BitMask &other);
+
+    // Return the number of set pixels.
+    //
+    unsigned count() const;
+
+    // Return the number of set pixels of row y from column begin to end - 1.
+    //
+    unsigned count(int y, int begin, int end) const;
+
+    // Return the moments of the set pixels.
+    //
+    BitMaskMoments moments() const;
+
+    // Like cv::erode() and cv::dilate() with a size x size rectangle and
+    // the default anchor and border, in time growing with log2(size) at most.
+    //
+    void erode(int size);
+    void dilate(int size);
+
+    // Return the 8-connected components of the set pixels, with the
+    // number of pixels in each. Unlike the external contours of
+    // cv::findContours() and their cv::contourArea(), the holes in a
+    // component do not count towards its area, and a component inside
+    // the hole of another is returned as one of its own.
+    //
+    std::vector<BitMaskComponent> components() const;
+
+    // Unpack into a CV_8UC1 image of 0s and 255s, for display.
+    //
+    void toMat(cv::Mat &into) const;
+};
+
+#endif // #ifndef BIT_MASK_H_INCLUDED
@@ -7,6 +7,7 @@
 #include "Butterworth.hpp"
 
 #include <algorithm>
+#include <cmath>
 #include <complex>
 #include <stdexcept>
 
@@ -250,3 +251,36 @@ void butterworth(unsigned int N, double Wn,
     out_b.reserve(b.size());
     for (unsigned k = 0; k < b.size(); ++k) out_b.push_back(std::real(b[k]));
 }
+
+// Entries per nominal frame, and the longest interval, in frames. Past
+// a cut-off of 0.95 of the Nyquist frequency of an interval, the filter
+// only follows its input.
+//
+#define TABLE_STEPS 8
+#define TABLE_FRAMES 16
+#define TABLE_MAX_WN 0.95
+
+void ButterworthTable::compute(double frequency, double fps)
+{
+    const int count = TABLE_STEPS * TABLE_FRAMES + 1;
+    itsSteps = TABLE_STEPS * fps;
+    itsB0.assign(count, 0.0f);
+    itsB1.assign(count, 0.0f);
+    itsA1.assign(count, 0.0f);
+    std::vector<double> a, b;
+    for (int k = 1; k < count; k++) {
+        const double Wn = std::min(TABLE_MAX_WN, 2.0 * frequency * k / itsSteps);
+        butterworth(1, Wn, a, b);
+        itsB0[k] = b[0] / a[0];
+        itsB1[k] = b[1] / a[0];
+        itsA1[k] = a[1] / a[0];
+    }
+}
+
+ButterworthTable::Coefficients ButterworthTable::at(double seconds) const
+{
+    const int last = itsB0.size() - 1;
+    const int k = seconds > 0 ? std::max(1, std::min(last, (int)lround(seconds * itsSteps)))
+                              : TABLE_STEPS;
+    return Coefficients{itsB0[k], itsB1[k], itsA1[k]};
+}
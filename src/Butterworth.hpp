@@ -18,4 +18,31 @@ extern void butterworth(unsigned int N, double Wn,
                         std::vector<double> &out_a,
                         std::vector<double> &out_b);
 
+// The first order low-pass Butterworth coefficients at one cut-off
+// frequency for every interval between frames from an eighth of a frame
+// at the nominal rate up to 16 frames, in steps of an eighth, normalized
+// so that a[0] is 1. A frame is then filtered for the time since the last
+// one at the cost of a lookup, so a late or dropped frame does not shift
+// the passband.
+//
+class ButterworthTable {
+    std::vector<float> itsB0, itsB1, itsA1;
+    double itsSteps;                   // entries per second
+
+public:
+
+    struct Coefficients { float b0, b1, a1; };
+
+    // Fill the table for frequency at a nominal fps frames per second.
+    //
+    void compute(double frequency, double fps);
+
+    // Return the coefficients for the entry nearest seconds, or for the
+    // nominal interval if seconds is not positive.
+    //
+    Coefficients at(double seconds) const;
+
+    ButterworthTable(): itsB0(), itsB1(), itsA1(), itsSteps(0.0) {}
+};
+
 #endif // #ifndef BUTTERWORTH_H_INCLUDED
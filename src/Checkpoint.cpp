@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "Checkpoint.hpp"
+
+CheckpointWriter::CheckpointWriter(const std::string &path)
+    : itsPath(path)
+    , itsTemporary(path + ".tmp")
+    , itsFile(itsTemporary.c_str(), std::ios::binary | std::ios::trunc)
+{
+    itsFile.write(CHECKPOINT_MAGIC, strlen(CHECKPOINT_MAGIC));
+    put((int32_t)CHECKPOINT_VERSION);
+}
+
+void
+CheckpointWriter::put(const cv::Rect &rect)
+{
+    put((int32_t)rect.x);
+    put((int32_t)rect.y);
+    put((int32_t)rect.width);
+    put((int32_t)rect.height);
+}
+
+void
+CheckpointWriter::put(const cv::Mat &m)
+{
+    put((int32_t)m.rows);
+    put((int32_t)m.cols);
+    put((int32_t)m.type());
+    const size_t rowBytes = m.cols * m.elemSize();
+    for (int y = 0; y < m.rows; y++) {
+        itsFile.write((const char *)m.ptr(y), rowBytes);
+    }
+}
+
+bool
+CheckpointWriter::commit()
+{
+    itsFile.close();
+    if (itsFile.fail()) {
+        remove(itsTemporary.c_str());
+        return false;
+    }
+    return rename(itsTemporary.c_str(), itsPath.c_str()) == 0;
+}
+
+CheckpointReader::CheckpointReader(const std::string &path)
+    : itsFile(path.c_str(), std::ios::binary)
+    , itsOk(itsFile.is_open())
+{
+    char magic[sizeof(CHECKPOINT_MAGIC) - 1];
+    read(magic, sizeof(magic));
+    itsOk = itsOk && memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) == 0;
+    itsOk = itsOk && getInt() == CHECKPOINT_VERSION;
+}
+
+void
+CheckpointReader::read(void *into, size_t bytes)
+{
+    if (itsOk) {
+        itsFile.read((char *)into, bytes);
+        itsOk = (size_t)itsFile.gcount() == bytes;
+    }
+    if (!itsOk) {
+        memset(into, 0, bytes);
+    }
+}
+
+int32_t
+CheckpointReader::getInt()
+{
+    int32_t result;
+    read(&result, sizeof(result));
+    return result;
+}
+
+double
+CheckpointReader::getDouble()
+{
+    double result;
+    read(&result, sizeof(result));
+    return result;
+}
+
+cv::Rect
+CheckpointReader::getRect()
+{
+    const int x = getInt();
+    const int y = getInt();
+    const int width = getInt();
+    const int height = getInt();
+    return cv::Rect(x, y, width, height);
+}
+
+void
+CheckpointReader::get(cv::Mat &m)
+{
+    const int rows = getInt();
+    const int cols = getInt();
+    const int type = getInt();
+    itsOk = itsOk && rows >= 0 && rows <= CHECKPOINT_MAX_SIDE
+        && cols >= 0 && cols <= CHECKPOINT_MAX_SIDE
+        && (type & ~CV_MAT_TYPE_MASK) == 0;
+    getPixels(m, rows, cols, type);
+}
+
+void
+CheckpointReader::get(cv::Mat &m, const cv::Size &size, int type)
+{
+    const int rows = getInt();
+    const int cols = getInt();
+    itsOk = itsOk && rows == size.height && cols == size.width && getInt() == type
+        && rows >= 0 && rows <= CHECKPOINT_MAX_SIDE
+        && cols >= 0 && cols <= CHECKPOINT_MAX_SIDE;
+    getPixels(m, rows, cols, type);
+}
+
+// Read the pixels of a rows x cols matrix of type into m, which is
+// released instead if the reader is no longer ok.
+//
+void
+CheckpointReader::getPixels(cv::Mat &m, int rows, int cols, int type)
+{
+    if (!itsOk) {
+        m.release();
+        return;
+    }
+    m.create(rows, cols, type);
+    const size_t rowBytes = m.cols * m.elemSize();
+    for (int y = 0; y < m.rows; y++) {
+        read(m.ptr(y), rowBytes);
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef CHECKPOINT_H_INCLUDED
+#define CHECKPOINT_H_INCLUDED
+
+#include <stdint.h>
+
+#include <fstream>
+#include <string>
+
+#include <opencv2/core/core.hpp>
+
+#define CHECKPOINT_MAGIC "CRIBSAVE"
+#define CHECKPOINT_VERSION 2
+
+// A matrix bigger than this on either side is taken as corruption rather
+// than allocated.
+#define CHECKPOINT_MAX_SIDE 8192
+
+// Writes a checkpoint: CHECKPOINT_MAGIC, CHECKPOINT_VERSION, and then
+// whatever is put, field by field in native byte order, as a checkpoint
+// is only read back on the machine that wrote it. The file is written
+// beside path and renamed over it by commit(), so a crash midway leaves
+// the last checkpoint alone.
+//
+class CheckpointWriter {
+    const std::string itsPath;
+    const std::string itsTemporary;
+    std::ofstream itsFile;
+
+public:
+
+    explicit CheckpointWriter(const std::string &path);
+
+    void put(int32_t value)    { itsFile.write((const char *)&value, sizeof(value)); }
+    void put(double value)     { itsFile.write((const char *)&value, sizeof(value)); }
+    void put(const cv::Rect &rect);
+
+    // Put the size, type and pixels of a matrix.
+    //
+    void put(const cv::Mat &m);
+
+    // Replace the checkpoint at path with what was put, and return true,
+    // or false if it could not be written.
+    //
+    bool commit();
+};
+
+// Reads back what a CheckpointWriter put, in the same order. Once a read
+// fails, the reader is not ok() and every later read returns 0 or empty.
+//
+class CheckpointReader {
+    std::ifstream itsFile;
+    bool itsOk;
+
+    void read(void *into, size_t bytes);
+    void getPixels(cv::Mat &m, int rows, int cols, int type);
+
+public:
+
+    // Open path and check its magic and version.
+    //
+    explicit CheckpointReader(const std::string &path);
+
+    bool ok() const { return itsOk; }
+
+    int32_t getInt();
+    double getDouble();
+    cv::Rect getRect();
+
+    // Get a matrix into m, reusing its memory if it is the same size and
+    // type already.
+    //
+    void get(cv::Mat &m);
+
+    // Get a matrix into m as above, failing unless it is of size and type.
+    //
+    void get(cv::Mat &m, const cv::Size &size, int type);
+};
+
+#endif // #ifndef CHECKPOINT_H_INCLUDED
@@ -5,9 +5,11 @@
  */
 
 #include "CommandLine.hpp"
+#include "LinearTransform.hpp"
 #include "RieszTransform.hpp"
 #include "VideoSource.hpp"
 
+#include <sstream>
 #include <sys/time.h>
 
 const char *CommandLine::acknowlegements()
@@ -39,10 +41,28 @@ void CommandLine::showUsage(const std::string &program, std::ostream &os)
 {
     os << std::endl << program << ": Amplify motion in a video." << std::endl
        << std::endl
-       << "Usage: " << program << " [--config] <path>" << std::endl
+       << "Usage: " << program << " [--config] <path>"
+       << " [--stream <path>]... [--supervise]"
+       << " [--batch <path> [--output <dir>]] [--jobs <n>] [--benchmark]" << std::endl
        << std::endl
        << "Where: " << "--config specifies the path to the config INI." << std::endl
-       << "Example: " << program << " --config config.ini"
+       << "       --stream adds a camera or file configured by another INI;" << std::endl
+       << "       all streams are then monitored in this one process," << std::endl
+       << "       or with --supervise, each in a worker process of its own." << std::endl
+       << "       --batch analyzes every recording in a directory, or listed" << std::endl
+       << "       one per line in a manifest, instead of the configured input." << std::endl
+       << "       --output is where the batch CSV files go (default .)." << std::endl
+       << "       --jobs is the number of frames or recordings analyzed" << std::endl
+       << "       at once (default one per core)." << std::endl
+       << "       --benchmark runs the configured input, or each recording" << std::endl
+       << "       of --batch, through both magnification engines in turn" << std::endl
+       << "       and compares their cost and results." << std::endl
+       << "Example: " << program << " --config config.ini" << std::endl
+       << "         " << program << " --config crib1.ini --stream crib2.ini --stream crib3.ini"
+       << std::endl
+       << "         " << program << " --config config.ini --batch nights/ --output scores/"
+       << std::endl
+       << "         " << program << " --config config.ini --batch nights/ --benchmark"
        << std::endl << std::endl;
 }
 
@@ -65,12 +85,69 @@ std::ostream &operator<<(std::ostream &os, const CommandLine &cl)
 
 // Always set highCutoff before lowCutoff.
 //
-void CommandLine::apply(RieszTransform &rt) const
+void CommandLine::apply(Transform &rt) const
 {
     if (amplify    >= 0) rt.alpha(amplify);
     if (highCutoff >  0) rt.highCutoff(highCutoff);
     if (lowCutoff  >  0) rt.lowCutoff(lowCutoff);
     if (threshold  >= 0) rt.threshold(threshold);
+    for (const auto &band : extraBands) {
+        rt.addBand(band.first, band.second);
+    }
+    if (coarseLevels > 0) rt.decimate(coarseLevels, coarseEvery);
+    rt.warmStart(warmStart);
+}
+
+// Parse bands such as "0.2-0.5, 1.5-3" into result, and return true if
+// each one is a low-high pair of frequencies with 0 < low <= high.
+//
+static bool
+parseBands(const std::string &list, std::vector<std::pair<double, double>> &result)
+{
+    std::stringstream in(list);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        std::stringstream band(item);
+        double low = 0, high = 0;
+        char dash = 0;
+        if (!(band >> low >> dash >> high) || dash != '-' || low <= 0 || high < low) {
+            return false;
+        }
+        result.push_back(std::make_pair(low, high));
+    }
+    return true;
+}
+
+// Parse a polygon such as "10,20 300,20 300,240" into result, and return
+// true if it is empty or has at least 3 x,y points.
+//
+static bool
+parsePolygon(const std::string &list, std::vector<std::pair<int, int>> &result)
+{
+    std::stringstream in(list);
+    std::string item;
+    while (in >> item) {
+        std::stringstream point(item);
+        int x = 0, y = 0;
+        char comma = 0;
+        if (!(point >> x >> comma >> y) || comma != ',' || x < 0 || y < 0) {
+            return false;
+        }
+        result.push_back(std::make_pair(x, y));
+    }
+    return result.empty() || result.size() >= 3;
+}
+
+std::unique_ptr<Transform> CommandLine::makeTransform() const
+{
+    std::unique_ptr<Transform> result;
+    if (magnifier == "linear") {
+        result.reset(new LinearTransform());
+    } else {
+        result.reset(new RieszTransform());
+    }
+    apply(*result);
+    return result;
 }
 
 // Defaults for transform settings should be OK for the minimum frame rate.
@@ -78,7 +155,20 @@ void CommandLine::apply(RieszTransform &rt) const
 CommandLine::CommandLine(int ac, char *av[])
     : av0(av[0])
     , program()
+    , configPath()
     , inFile()
+    , inFormat("auto")
+    , recordPath()
+    , recordHours(1.0)
+    , checkpointPath()
+    , checkpointInterval(60.0)
+    , batchPath()
+    , batchOutput(".")
+    , jobs(0)
+    , streams()
+    , supervise(false)
+    , benchmark(false)
+    , workerRing()
     , cameraId(-1)
     , sourceCount(0)
     , erodeDimension(2)
@@ -86,10 +176,25 @@ CommandLine::CommandLine(int ac, char *av[])
     , diffThreshold(5)
     , motionDuration(1)
     , pixelThreshold(10)
+    , engine("pixels")
+    , phaseThreshold(5)
+    , roiMethod("blobs")
+    , tileSize(32)
+    , maxRegions(1)
+    , maskImage()
+    , maskPolygon()
     , amplify(30.0)
+    , magnifyFps(0.0)
     , lowCutoff(0.5)
     , highCutoff(1.0)
     , threshold(25.0)
+    , magnifier("riesz")
+    , extraBands()
+    , coarseLevels(0)
+    , coarseEvery(2)
+    , warmStart(false)
+    , rateEstimator("peaks")
+    , rateWindow(15.0)
     , showDiff(false)
     , showMagnification(false)
     , showTimes(false)
@@ -97,6 +202,7 @@ CommandLine::CommandLine(int ac, char *av[])
     , help(false)
     , ok(true)           // Check this before use.
     , crop(false)
+    , track(false)
     , frameWidth(640)
     , frameHeight(480)
 {
@@ -121,7 +227,21 @@ CommandLine::CommandLine(int ac, char *av[])
             config_path = av[i];
             use_config_file = true;
             ok = true;
-            break;
+        } else if ("--stream" == arg && (ok = ++i < ac)) {
+            streams.push_back(av[i]);
+        } else if ("--supervise" == arg) {
+            supervise = true;
+        } else if ("--benchmark" == arg) {
+            benchmark = true;
+        } else if ("--worker" == arg && (ok = ++i < ac)) {
+            workerRing = av[i];
+        } else if ("--batch" == arg && (ok = ++i < ac)) {
+            batchPath = av[i];
+        } else if ("--output" == arg && (ok = ++i < ac)) {
+            batchOutput = av[i];
+        } else if ("--jobs" == arg && (ok = ++i < ac)) {
+            std::stringstream jobsArg(av[i]);
+            ok = !!(jobsArg >> jobs);
         } else {
             std::cerr << std::endl << program << ": Bad option '" << arg << "'"
                       << std::endl;
@@ -131,117 +251,191 @@ CommandLine::CommandLine(int ac, char *av[])
 
     // Of user specifies to use INI file on commandline, load these arguments
     // from the file rather than the commandline.
-    if (use_config_file) {
-        sourceCount = 0;
-        static INIReader reader(config_path);
+    if (use_config_file && !load(config_path)) {
+        return;
+    }
 
-        if (reader.ParseError() < 0) {
-            printf("[error] Cannot load %s\n", config_path.c_str());
-            ok = false;
-            return;
-        }
+    if (about) std::cout << program << acknowlegements() << std::endl;
+    if (!ok) showUsage(program, std::cerr);
+}
 
-        // check sources
-        std::string input_path = reader.Get("io", "input", "");
-        if (input_path != "") {
-            inFile = input_path;
-            ok = ok && sourceCount == 0;
-            ++sourceCount;
-        }
+// Load into this the settings in the INI file, which are all optional.
+//
+bool CommandLine::load(const std::string &config_path)
+{
+    configPath = config_path;
+    sourceCount = 0;
+    inFile = "";
+    cameraId = -1;
+    INIReader reader(config_path);
+
+    if (reader.ParseError() < 0) {
+        printf("[error] Cannot load %s\n", config_path.c_str());
+        ok = false;
+        return ok;
+    }
 
-        int input_cameraID = reader.GetInteger("io", "camera", -1);
-        if (input_cameraID != -1) {
-            cameraId = input_cameraID;
-            ok = ok && cameraId >= 0 && sourceCount == 0;
-            ++sourceCount;
-        }
+    // check sources
+    std::string input_path = reader.Get("io", "input", "");
+    if (input_path != "") {
+        inFile = input_path;
+        ok = ok && sourceCount == 0;
+        ++sourceCount;
+    }
 
-        // Validate that input is EITHER camera or file.
-        if (sourceCount > 1) {
-            std::cerr << program << ": Specify only one of --camera or --input."
-                      << std::endl << std::endl;
-            ok = false;
-            return;
-        }
-        if (!(sourceCount)) if (!(about || help)) {
-            std::cerr << program << ": Specify at least 1 input."
-                      << std::endl << std::endl;
-        }
+    inFormat = reader.Get("io", "input_format", "auto");
+    ok = ok && (inFormat == "auto" || inFormat == "capture"
+                || inFormat == "raw" || inFormat == "y4m" || inFormat == "ring");
 
-        amplify = reader.GetReal("magnification", "amplify", 20);
-        ok = ok && amplify && amplify >= 0 && amplify <= 100;
+    int input_cameraID = reader.GetInteger("io", "camera", -1);
+    if (input_cameraID != -1) {
+        cameraId = input_cameraID;
+        ok = ok && cameraId >= 0 && sourceCount == 0;
+        ++sourceCount;
+    }
 
-        input_fps = reader.GetReal("io", "input_fps", 15);
-        if (input_cameraID != -1) {
-            // NoIR Camera can only handle 40fps max while retaining good
-            // performance in low-light.
-            ok = ok && input_fps && input_fps >= 0 && input_fps <= 40;
-        }
-        else {
-            ok = ok && input_fps && input_fps >= 0;
-        }
+    // Validate that input is EITHER camera or file.
+    if (sourceCount > 1) {
+        std::cerr << program << ": Specify only one of --camera or --input."
+                  << std::endl << std::endl;
+        ok = false;
+        return ok;
+    }
+    if (!(sourceCount)) if (!(about || help || !batchPath.empty() || !streams.empty())) {
+        std::cerr << program << ": Specify at least 1 input."
+                  << std::endl << std::endl;
+    }
+
+    amplify = reader.GetReal("magnification", "amplify", 20);
+    ok = ok && amplify && amplify >= 0 && amplify <= 100;
+
+    input_fps = reader.GetReal("io", "input_fps", 15);
+    if (input_cameraID != -1) {
+        // NoIR Camera can only handle 40fps max while retaining good
+        // performance in low-light.
+        ok = ok && input_fps && input_fps >= 0 && input_fps <= 40;
+    }
+    else {
+        ok = ok && input_fps && input_fps >= 0;
+    }
+
+    full_fps = reader.GetReal("io", "full_fps", 4.5);
+    ok = ok && full_fps && full_fps >= 0;
+
+    crop_fps = reader.GetReal("io", "crop_fps", 15);
+    ok = ok && crop_fps && crop_fps >= 0;
+
+    magnifyFps = reader.GetReal("io", "magnify_fps", 0);
+    ok = ok && magnifyFps >= 0;
+
+    lowCutoff = reader.GetReal("magnification", "low-cutoff", 0.7);
+    ok = ok && lowCutoff && lowCutoff >= 0;
 
-        full_fps = reader.GetReal("io", "full_fps", 4.5);
-        ok = ok && full_fps && full_fps >= 0;
+    highCutoff = reader.GetReal("magnification", "high-cutoff", 1);
+    ok = ok && highCutoff && highCutoff >= 0;
 
-        crop_fps = reader.GetReal("io", "crop_fps", 15);
-        ok = ok && crop_fps && crop_fps >= 0;
+    threshold = reader.GetReal("magnification", "threshold", 50);
+    ok = ok && threshold && threshold >= 0 && threshold <= 100;
 
-        lowCutoff = reader.GetReal("magnification", "low-cutoff", 0.7);
-        ok = ok && lowCutoff && lowCutoff >= 0;
+    magnifier = reader.Get("magnification", "engine", "riesz");
+    ok = ok && (magnifier == "riesz" || magnifier == "linear");
 
-        highCutoff = reader.GetReal("magnification", "high-cutoff", 1);
-        ok = ok && highCutoff && highCutoff >= 0;
+    extraBands.clear();
+    ok = ok && parseBands(reader.Get("magnification", "extra_bands", ""), extraBands);
+    ok = ok && extraBands.size() <= 4;
 
-        threshold = reader.GetReal("magnification", "threshold", 50);
-        ok = ok && threshold && threshold >= 0 && threshold <= 100;
+    coarseLevels = reader.GetInteger("magnification", "coarse_levels", 0);
+    ok = ok && coarseLevels >= 0 && coarseLevels <= 8;
 
-        frameWidth = reader.GetInteger("io", "width", 640);
-        ok = ok && frameWidth >= 320 && frameWidth <= 1920;
-        frameHeight = reader.GetInteger("io", "height", 480);
-        ok = ok && frameHeight >= 240 && frameHeight <= 1080;
+    coarseEvery = reader.GetInteger("magnification", "coarse_every", 2);
+    ok = ok && coarseEvery >= 1 && coarseEvery <= 8;
 
+    warmStart = reader.GetBoolean("magnification", "warm_start", false);
 
-        erodeDimension = reader.GetInteger("motion", "erode_dim", 3);
-        ok = ok && erodeDimension && erodeDimension > 0;
+    frameWidth = reader.GetInteger("io", "width", 640);
+    ok = ok && frameWidth >= 320 && frameWidth <= 1920;
+    frameHeight = reader.GetInteger("io", "height", 480);
+    ok = ok && frameHeight >= 240 && frameHeight <= 1080;
 
-        dilateDimension = reader.GetInteger("motion", "dilate_dim", 60);
-        ok = ok && dilateDimension && dilateDimension > 0;
 
-        diffThreshold = reader.GetInteger("motion", "diff_threshold", 10);
-        ok = ok && diffThreshold && diffThreshold >= 0;
+    erodeDimension = reader.GetInteger("motion", "erode_dim", 3);
+    ok = ok && erodeDimension && erodeDimension > 0;
 
-        motionDuration = reader.GetInteger("motion", "duration", 1);
-        ok = ok && motionDuration && motionDuration >= 1;
+    dilateDimension = reader.GetInteger("motion", "dilate_dim", 60);
+    ok = ok && dilateDimension && dilateDimension > 0;
 
-        pixelThreshold = reader.GetInteger("motion", "pixel_threshold", 5);
-        ok = ok && pixelThreshold && pixelThreshold >= 1;
+    diffThreshold = reader.GetInteger("motion", "diff_threshold", 10);
+    ok = ok && diffThreshold && diffThreshold >= 0;
 
-        showDiff = reader.GetBoolean("motion", "show_diff", false);
+    motionDuration = reader.GetInteger("motion", "duration", 1);
+    ok = ok && motionDuration && motionDuration >= 1;
 
-        showMagnification = reader.GetBoolean("magnification", "show_magnification", false);
+    pixelThreshold = reader.GetInteger("motion", "pixel_threshold", 5);
+    ok = ok && pixelThreshold && pixelThreshold >= 1;
 
-        showTimes = reader.GetBoolean("debug", "print_times", false);
+    engine = reader.Get("motion", "engine", "pixels");
+    ok = ok && (engine == "pixels" || engine == "phase");
 
-        crop = reader.GetBoolean("cropping", "crop", false);
+    phaseThreshold = reader.GetInteger("motion", "phase_threshold", 5);
+    ok = ok && phaseThreshold >= 1;
 
-        framesToSettle = reader.GetInteger("cropping", "frames_to_settle", 10);
-        ok = ok && framesToSettle && framesToSettle >= 1;
+    rateEstimator = reader.Get("motion", "rate_estimator", "peaks");
+    ok = ok && (rateEstimator == "peaks" || rateEstimator == "spectral");
 
-        timeToAlarm = reader.GetInteger("io", "time_to_alarm", 10);
-        ok = ok && timeToAlarm && timeToAlarm > 1;
+    rateWindow = reader.GetReal("motion", "rate_window", 15.0);
+    ok = ok && rateWindow > 0;
 
-        roiWindow = reader.GetInteger("cropping", "roi_window", 10);
-        ok = ok && roiWindow && roiWindow >= 1;
+    showDiff = reader.GetBoolean("motion", "show_diff", false);
 
-        roiUpdateInterval = reader.GetInteger("cropping", "roi_update_interval", 100);
-        ok = ok && roiUpdateInterval && roiUpdateInterval >= roiWindow;
+    showMagnification = reader.GetBoolean("magnification", "show_magnification", false);
 
+    showTimes = reader.GetBoolean("debug", "print_times", false);
 
-        about = reader.GetBoolean("io", "about", false);
-        help = reader.GetBoolean("io", "help", false);
+    recordPath = reader.Get("record", "path", "");
+
+    recordHours = reader.GetReal("record", "hours", 1.0);
+    ok = ok && recordHours > 0;
+
+    checkpointPath = reader.Get("checkpoint", "path", "");
+
+    checkpointInterval = reader.GetReal("checkpoint", "interval", 60.0);
+    ok = ok && checkpointInterval >= 1;
+
+    crop = reader.GetBoolean("cropping", "crop", false);
+    track = reader.GetBoolean("cropping", "track", false);
+    if (track && engine == "phase") {
+        printf("[error] track needs [motion] engine = pixels\n");
+        ok = false;
     }
 
-    if (about) std::cout << program << acknowlegements() << std::endl;
-    if (!ok) showUsage(program, std::cerr);
+    framesToSettle = reader.GetInteger("cropping", "frames_to_settle", 10);
+    ok = ok && framesToSettle && framesToSettle >= 1;
+
+    timeToAlarm = reader.GetInteger("io", "time_to_alarm", 10);
+    ok = ok && timeToAlarm && timeToAlarm > 1;
+
+    roiWindow = reader.GetInteger("cropping", "roi_window", 10);
+    ok = ok && roiWindow && roiWindow >= 1;
+
+    roiUpdateInterval = reader.GetInteger("cropping", "roi_update_interval", 100);
+    ok = ok && roiUpdateInterval && roiUpdateInterval >= roiWindow;
+
+    roiMethod = reader.Get("cropping", "roi_method", "blobs");
+    ok = ok && (roiMethod == "blobs" || roiMethod == "spectral");
+
+    tileSize = reader.GetInteger("cropping", "tile_size", 32);
+    ok = ok && tileSize >= 8 && tileSize <= 128;
+
+    maxRegions = reader.GetInteger("cropping", "max_regions", 1);
+    ok = ok && maxRegions >= 1 && maxRegions <= 4;
+
+    maskImage = reader.Get("mask", "image", "");
+
+    maskPolygon.clear();
+    ok = ok && parsePolygon(reader.Get("mask", "polygon", ""), maskPolygon);
+
+
+    about = reader.GetBoolean("io", "about", false);
+    help = reader.GetBoolean("io", "help", false);
+    return ok;
 }
@@ -7,11 +7,13 @@
 #ifndef COMMAND_LINE_H_INCLUDED
 #define COMMAND_LINE_H_INCLUDED
 
+#include <memory>
 #include <string>
+#include <vector>
 #include <sys/time.h>
 #include "INIReader.h"
 
-class RieszTransform;
+class Transform;
 
 // A command line for this program.
 //
@@ -19,7 +21,20 @@ struct CommandLine {
 
     const std::string av0;           // The zeroth command line argument.
     std::string program;             // The name of this program in messages.
+    std::string configPath;          // The INI file loaded or "".
     std::string inFile;              // The video input file or "".
+    std::string inFormat;            // auto, capture, raw, y4m or ring.
+    std::string recordPath;          // The ring file to record to or "".
+    double recordHours;              // Hours of frames kept in the ring.
+    std::string checkpointPath;      // The detector state file or "".
+    double checkpointInterval;       // Seconds between checkpoints.
+    std::string batchPath;           // Directory or manifest of recordings or "".
+    std::string batchOutput;         // Directory for the batch CSV files.
+    unsigned jobs;                   // Pool threads, 0 for one per core.
+    std::vector<std::string> streams; // INI files of further streams.
+    bool supervise;                  // Run each stream in a worker process.
+    bool benchmark;                  // Compare the magnification engines.
+    std::string workerRing;          // Shared memory a worker reads or "".
     int cameraId;                    // The camera if not negative.
     int sourceCount;                 // Count of video sources specified.
     int erodeDimension;              // Dimention of the erode kernel.
@@ -29,17 +44,35 @@ struct CommandLine {
     int motionDuration;              // # of frames motion must be detected.
     int pixelThreshold;              // # of pixels that must be different
                                      //   to be flagged as motion.
+    std::string engine;              // pixels or phase.
+    int phaseThreshold;              // milliradians of phase motion that
+                                     //   are flagged as motion.
     unsigned timeToAlarm;            // # of seconds to wait before sounding alarm.
     unsigned framesToSettle;         // # frames to ignore on startup and reset
     unsigned roiUpdateInterval;      // # frames between roi updates
     unsigned roiWindow;              // # frames to consider when calculating roi
+    std::string roiMethod;           // blobs or spectral.
+    int tileSize;                    // pixels on a side of a spectral roi tile
+    int maxRegions;                  // # regions of interest monitored at once
+    std::string maskImage;           // image of the area to watch or "".
+    std::vector<std::pair<int, int>> maskPolygon; // x, y of the corners of
+                                     //   the area to watch, or none.
     double amplify;                  // The current amplification.
     double input_fps;                // fps to read from the input
     double full_fps;                 // fps at which full frames can be processed
     double crop_fps;                 // fps at which cropped frames can be processed
+    double magnifyFps;               // fps at which crops are magnified, 0 for all
     double lowCutoff;                // The low frequency of the bandpass.
     double highCutoff;               // The high frequency of the bandpass.
     double threshold;                // The phase threshold as % of pi.
+    std::string magnifier;           // riesz or linear.
+    std::vector<std::pair<double, double>> extraBands; // more passbands
+                                     //   measured, low and high in Hz.
+    int coarseLevels;                // # coarsest levels updated less often
+    int coarseEvery;                 // # frames between their updates
+    bool warmStart;                  // start the filters settled
+    std::string rateEstimator;       // peaks or spectral.
+    double rateWindow;               // seconds the spectral estimator sees.
     bool showDiff;                   // optionally show the diff between frames
     bool showMagnification;          // optionally show the magnification output
     bool showTimes;                  // optionally print the times between frames
@@ -47,6 +80,7 @@ struct CommandLine {
     bool help;                       // True iff --help.
     bool ok;                         // True if (ac, av) parse is valid.
     bool crop;                       // True if adaptive crop is enabled.
+    bool track;                      // True to follow motion within the crop.
     int frameWidth;
     int frameHeight;
 
@@ -64,7 +98,16 @@ struct CommandLine {
 
     // Apply the settings here to rt or md.
     //
-    void apply(RieszTransform &rt) const;
+    void apply(Transform &rt) const;
+
+    // Return a new transform of the magnifier engine with these settings.
+    //
+    std::unique_ptr<Transform> makeTransform() const;
+
+    // Load the settings in the INI file at config_path into this, and
+    // return ok.
+    //
+    bool load(const std::string &config_path);
 
     // Parse command line options from ac and av as passed to main().
     //
@@ -0,0 +1,63 @@
+#include <stdexcept>
+
+#include <opencv2/opencv.hpp>
+
+#include "ExclusionMask.hpp"
+
+ExclusionMask::ExclusionMask(cv::Size frame, int size, const std::string &path,
+                             const std::vector<std::pair<int, int>> &polygon)
+    : itsBounds()
+    , itsBlanked()
+{
+    cv::Mat watch(frame, CV_8UC1, cv::Scalar(255));
+    if (!path.empty()) {
+        const cv::Mat image = cv::imread(path, cv::IMREAD_GRAYSCALE);
+        if (image.empty()) {
+            throw std::runtime_error("Cannot read mask image " + path);
+        }
+        cv::Mat scaled;
+        cv::resize(image, scaled, frame, 0, 0, cv::INTER_NEAREST);
+        watch.setTo(cv::Scalar(0), scaled == 0);
+    }
+    if (!polygon.empty()) {
+        std::vector<std::vector<cv::Point>> points(1);
+        for (const auto &p : polygon) {
+            points[0].push_back(cv::Point(p.first, p.second));
+        }
+        cv::Mat inside(frame, CV_8UC1, cv::Scalar(0));
+        cv::fillPoly(inside, points, cv::Scalar(255));
+        watch.setTo(cv::Scalar(0), inside == 0);
+    }
+
+    const cv::Rect whole(cv::Point(0, 0), frame);
+    std::vector<cv::Rect> excluded;
+    for (int y = 0; y < frame.height; y += size) {
+        for (int x = 0; x < frame.width; x += size) {
+            const cv::Rect tile = cv::Rect(x, y, size, size) & whole;
+            if (cv::countNonZero(watch(tile))) {
+                itsBounds = itsBounds.area() ? itsBounds | tile : tile;
+            }
+            else {
+                excluded.push_back(tile);
+            }
+        }
+    }
+    for (const cv::Rect &tile : excluded) {
+        if ((tile & itsBounds) == tile) {
+            itsBlanked.push_back(tile - itsBounds.tl());
+        }
+    }
+}
+
+cv::Mat
+ExclusionMask::apply(const cv::Mat &frame) const
+{
+    if (itsBlanked.empty()) {
+        return frame(itsBounds);
+    }
+    cv::Mat result = frame(itsBounds).clone();
+    for (const cv::Rect &tile : itsBlanked) {
+        result(tile).setTo(cv::Scalar(0));
+    }
+    return result;
+}
@@ -0,0 +1,44 @@
+#ifndef EXCLUSION_MASK_H_INCLUDED
+#define EXCLUSION_MASK_H_INCLUDED
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+// The tiles of a frame worth analyzing: those that overlap the area to
+// watch, the pixels that are not black in an image of the frame and
+// within a polygon, where either is given. The rest, such as a ceiling
+// fan, curtains or a TV, is excluded whole tiles at a time.
+//
+// Only bounds(), the smallest rectangle of tiles around the watched
+// ones, is analyzed at all. Excluded tiles inside of it are blanked to
+// black, so they never move.
+//
+class ExclusionMask {
+    cv::Rect itsBounds;                // of the watched tiles in the frame
+    std::vector<cv::Rect> itsBlanked;  // excluded tiles, relative to itsBounds
+
+public:
+
+    // Mask frames of size frame in tiles of size x size pixels. The image
+    // at path, if not "", is scaled to the frame, and polygon, if it has
+    // points, is in pixels of the frame. Throw if the image cannot be read.
+    //
+    ExclusionMask(cv::Size frame, int size, const std::string &path,
+                  const std::vector<std::pair<int, int>> &polygon);
+
+    // Return true if no tile is watched.
+    //
+    bool empty() const { return itsBounds.area() == 0; }
+
+    const cv::Rect &bounds() const { return itsBounds; }
+
+    // Return the bounds() of frame, with the excluded tiles in it
+    // blanked in a copy, or frame itself if none is.
+    //
+    cv::Mat apply(const cv::Mat &frame) const;
+};
+
+#endif // #ifndef EXCLUSION_MASK_H_INCLUDED
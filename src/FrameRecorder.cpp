@@ -0,0 +1,184 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+
+#include "FrameRecorder.hpp"
+#include "VideoSource.hpp"
+
+// Frames copied but not yet written to the ring. Beyond this, frames are
+// dropped rather than blocking the capture loop.
+#define MAX_PENDING_FRAMES 16
+
+// Slots of the ring mapped at once, so that multi-gigabyte rings fit in
+// a 32-bit address space.
+#define RECORD_WINDOW_SLOTS 32
+
+static inline uint64_t
+roundUp(uint64_t bytes, uint64_t multiple) {
+    return (bytes + multiple - 1) / multiple * multiple;
+}
+
+FrameRecorder::FrameRecorder(const std::string &path, double hours, double fps)
+    : itsPath(path)
+    , itsHours(hours)
+    , itsFps(fps)
+    , itsFd(-1)
+    , itsPageBytes(sysconf(_SC_PAGESIZE))
+    , itsHeaderMap()
+    , itsHeader(nullptr)
+    , itsWindow()
+    , itsWindowFirst(0)
+    , itsWindowCount(0)
+    , itsPool()
+    , itsNextBuffer(0)
+    , itsPending(0)
+    , itsDropped(0)
+    , itsThread()
+{}
+
+// A no-op queued behind the pending writes, to wait for them.
+//
+static bool
+drain(FrameRecorder *, cv::Mat, uint64_t) {
+    return true;
+}
+
+FrameRecorder::~FrameRecorder() {
+    if (itsHeader == nullptr)
+        return;
+    itsThread.push(drain, this, cv::Mat(), 0).wait();
+    if (itsWindow)
+        msync(itsWindow->get(), itsWindow->size(), MS_SYNC);
+    msync(itsHeaderMap->get(), itsHeaderMap->size(), MS_SYNC);
+    printf("[info] Recorded %" PRIu64 " frames to %s (%" PRIu64 " dropped).\n",
+           itsHeader->written, itsPath.c_str(), itsDropped);
+    itsWindow.reset();
+    itsHeaderMap.reset();
+    close(itsFd);
+}
+
+// Create the ring for frames like frame, or resume the existing one if
+// it was recorded with the same geometry and capacity.
+//
+void
+FrameRecorder::open(const cv::Mat &frame)
+{
+    const uint64_t slotBytes = roundUp(sizeof(uint64_t) + (uint64_t)frame.cols * frame.rows, itsPageBytes);
+    const uint64_t capacity = std::max<uint64_t>(1, itsHours * 3600.0 * itsFps);
+    const uint64_t fileBytes = itsPageBytes + capacity * slotBytes;
+
+    itsFd = ::open(itsPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (itsFd < 0)
+        throw std::system_error(errno, std::system_category(), "Failed to open " + itsPath);
+
+    ring_header old;
+    const bool resume
+        =  pread(itsFd, &old, sizeof(old), 0) == sizeof(old)
+        && memcmp(old.magic, RING_MAGIC, sizeof(old.magic)) == 0
+        && old.version == RING_VERSION
+        && old.width == (uint32_t)frame.cols
+        && old.height == (uint32_t)frame.rows
+        && old.headerBytes == itsPageBytes
+        && old.slotBytes == slotBytes
+        && old.capacity == capacity;
+
+    if (!resume && ftruncate(itsFd, 0) < 0)
+        throw std::system_error(errno, std::system_category());
+
+    // Allocate every block up front so that the writer never has to.
+    const int err = posix_fallocate(itsFd, 0, fileBytes);
+    if (err != 0)
+        throw std::system_error(err, std::system_category(), "Failed to allocate " + itsPath);
+
+    itsHeaderMap.reset(new mmap_buffer(itsFd, 0, itsPageBytes));
+    itsHeader = static_cast<ring_header *>(itsHeaderMap->get());
+    if (!resume) {
+        memcpy(itsHeader->magic, RING_MAGIC, sizeof(itsHeader->magic));
+        itsHeader->version = RING_VERSION;
+        itsHeader->width = frame.cols;
+        itsHeader->height = frame.rows;
+        itsHeader->headerBytes = itsPageBytes;
+        itsHeader->slotBytes = slotBytes;
+        itsHeader->capacity = capacity;
+        itsHeader->written = 0;
+    }
+
+    for (int i = 0; i < MAX_PENDING_FRAMES; i++)
+        itsPool.push_back(cv::Mat(frame.rows, frame.cols, CV_8UC1));
+
+    printf("[info] Recording to %s: %" PRIu64 " frames, starting at %" PRIu64 ".\n",
+           itsPath.c_str(), capacity, itsHeader->written);
+}
+
+// Map the window of slots containing slot, if it is not mapped already.
+//
+void
+FrameRecorder::mapWindow(uint64_t slot)
+{
+    if (itsWindow && slot >= itsWindowFirst && slot < itsWindowFirst + itsWindowCount)
+        return;
+    if (itsWindow)
+        msync(itsWindow->get(), itsWindow->size(), MS_ASYNC);
+    itsWindow.reset();
+
+    itsWindowFirst = slot - slot % RECORD_WINDOW_SLOTS;
+    itsWindowCount = std::min<uint64_t>(RECORD_WINDOW_SLOTS, itsHeader->capacity - itsWindowFirst);
+    itsWindow.reset(new mmap_buffer(itsFd,
+                                    itsHeader->headerBytes + itsWindowFirst * itsHeader->slotBytes,
+                                    itsWindowCount * itsHeader->slotBytes));
+}
+
+// Runs on itsThread: copy frame into the next slot of the ring.
+//
+bool
+FrameRecorder::writeSlot(FrameRecorder *recorder, cv::Mat frame, uint64_t timestamp)
+{
+    ring_header *const header = recorder->itsHeader;
+    const uint64_t slot = header->written % header->capacity;
+    recorder->mapWindow(slot);
+
+    unsigned char *const base = static_cast<unsigned char *>(recorder->itsWindow->get())
+        + (slot - recorder->itsWindowFirst) * header->slotBytes;
+    memcpy(base, &timestamp, sizeof(timestamp));
+    unsigned char *const luma = base + sizeof(timestamp);
+    for (int y = 0; y < frame.rows; y++)
+        memcpy(luma + (size_t)y * frame.cols, frame.ptr(y), frame.cols);
+
+    // Only count the frame once its data is in place.
+    header->written++;
+    recorder->itsPending--;
+    return true;
+}
+
+void
+FrameRecorder::record(const cv::Mat &frame, uint64_t timestamp)
+{
+    if (itsHeader == nullptr)
+        open(frame);
+
+    if (frame.type() != CV_8UC1
+        || frame.cols != (int)itsHeader->width
+        || frame.rows != (int)itsHeader->height
+        || itsPending >= itsPool.size()) {
+        itsDropped++;
+        return;
+    }
+
+    // The pool is recycled in the same order the writer consumes it, so
+    // with fewer than itsPool.size() frames pending, this one is free.
+    cv::Mat &copy = itsPool[itsNextBuffer];
+    frame.copyTo(copy);
+    itsNextBuffer = (itsNextBuffer + 1) % itsPool.size();
+    itsPending++;
+    itsThread.push(&FrameRecorder::writeSlot, this, copy, timestamp);
+}
@@ -0,0 +1,87 @@
+#ifndef FRAME_RECORDER_H_INCLUDED
+#define FRAME_RECORDER_H_INCLUDED
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "WorkerThread.hpp"
+
+#define RING_MAGIC "CRIBRING"
+#define RING_VERSION 1
+
+class mmap_buffer;
+
+// The first page of a ring file. It is followed by capacity slots of
+// slotBytes each (a multiple of the page size), and every slot holds a
+// uint64_t capture timestamp in microseconds followed by the luma plane.
+//
+// Once written exceeds capacity, the oldest frame is in slot
+// written % capacity.
+//
+struct ring_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t headerBytes;              // offset of the first slot
+    uint64_t slotBytes;
+    uint64_t capacity;                 // number of slots
+    uint64_t written;                  // frames written since creation
+};
+
+// Records the luma frames fed to the detector, bit for bit, into a
+// preallocated ring file that can be replayed with input_format = ring.
+//
+// record() only copies the frame into a recycled buffer. The copy into
+// the mapped file happens on a worker thread, and a frame is dropped
+// (and counted) rather than stalling the caller when the disk is behind.
+//
+class FrameRecorder {
+    const std::string itsPath;
+    const double itsHours;
+    const double itsFps;
+    int itsFd;
+    size_t itsPageBytes;
+    std::unique_ptr<mmap_buffer> itsHeaderMap;
+    ring_header *itsHeader;
+    std::unique_ptr<mmap_buffer> itsWindow;   // a few slots mapped at a time
+    uint64_t itsWindowFirst;
+    uint64_t itsWindowCount;
+    std::vector<cv::Mat> itsPool;
+    unsigned itsNextBuffer;
+    std::atomic<unsigned> itsPending;
+    uint64_t itsDropped;
+    WorkerThread<bool, FrameRecorder*, cv::Mat, uint64_t> itsThread;
+
+    void open(const cv::Mat &frame);
+    void mapWindow(uint64_t slot);
+    static bool writeSlot(FrameRecorder *recorder, cv::Mat frame, uint64_t timestamp);
+
+public:
+
+    // Record to path a ring of at most hours worth of frames at fps.
+    // The file is created or resumed on the first frame.
+    //
+    FrameRecorder(const std::string &path, double hours, double fps);
+
+    ~FrameRecorder();
+
+    FrameRecorder(const FrameRecorder&) = delete;
+    FrameRecorder &operator=(const FrameRecorder&) = delete;
+
+    // Queue a CV_8UC1 frame captured at timestamp (microseconds).
+    //
+    void record(const cv::Mat &frame, uint64_t timestamp);
+
+    // Return the number of frames dropped because the writer was behind.
+    //
+    uint64_t dropped() const { return itsDropped; }
+};
+
+#endif // #ifndef FRAME_RECORDER_H_INCLUDED
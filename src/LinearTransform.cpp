@@ -0,0 +1,319 @@
+/**
+ * This file is released is under the Patented Algorithm with Software released
+ * Agreement. See LICENSE.md for more information, and view the original repo
+ * at https://github.com/tbl3rd/Pyramids
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include "LinearTransform.hpp"
+
+#include "Butterworth.hpp"
+#include "Checkpoint.hpp"
+
+// A first order low-pass Butterworth filter at itsFrequency.
+//
+struct LinearTemporalFilter {
+    double itsFrequency;
+    ButterworthTable itsTable;
+
+    void computeCoefficients(double fps)
+    {
+        itsTable.compute(itsFrequency, fps);
+    }
+
+    // Advance result, the output for prior, to the output for input,
+    // seconds later.
+    //
+    void pass(cv::Mat &result, const cv::Mat &input, const cv::Mat &prior, double seconds) const
+    {
+        const ButterworthTable::Coefficients c = itsTable.at(seconds);
+        const float b0 = c.b0, b1 = c.b1, a1 = c.a1;
+        const int N = input.rows * input.cols;
+        const float * __restrict const inputData = input.ptr<float>(0);
+        const float * __restrict const priorData = prior.ptr<float>(0);
+        float * __restrict const resultData = result.ptr<float>(0);
+        for (int i = 0; i < N; i++) {
+            resultData[i] = b0 * inputData[i] + b1 * priorData[i] - a1 * resultData[i];
+        }
+    }
+
+    LinearTemporalFilter(double f): itsFrequency(f), itsTable() {}
+};
+
+// One level of a Laplacian pyramid, and the state of its filters.
+//
+struct LinearLevel {
+    cv::Mat itsLp;                     // the frame scaled to this octave
+    cv::Mat itsPrior;                  // itsLp of the last frame
+    std::vector<cv::Mat> itsLoPass;    // itsLp passed below the low cut-off
+    std::vector<cv::Mat> itsHiPass;    // and below the high cut-off, by band
+};
+
+struct LinearTransformState {
+    double itsFps;
+    std::vector<LinearTemporalFilter> itsLoCut; // of each band
+    std::vector<LinearTemporalFilter> itsHiCut;
+    std::vector<LinearLevel> itsLevel;
+
+    void computeFilter()
+    {
+        for (size_t b = 0; b < itsLoCut.size(); b++) {
+            itsLoCut[b].computeCoefficients(itsFps);
+            itsHiCut[b].computeCoefficients(itsFps);
+        }
+    }
+
+    static int countLevels(const cv::Size &size)
+    {
+        if (size.width > 5 && size.height > 5) {
+            const cv::Size halved((1 + size.width) / 2, (1 + size.height) / 2);
+            return 1 + countLevels(halved);
+        }
+        return 0;
+    }
+
+    void build(const cv::Mat &frame)
+    {
+        const size_t max = itsLevel.size() - 1;
+        cv::Mat octave = frame;
+        for (size_t i = 0; i < max; ++i) {
+            cv::Mat down, up;
+            cv::pyrDown(octave, down);
+            cv::pyrUp(down, up, octave.size());
+            itsLevel[i].itsLp = octave - up;
+            octave = down;
+        }
+        itsLevel[max].itsLp = octave;
+    }
+
+    // Levels of the same size as before keep their memory.
+    //
+    void initialize(const cv::Mat &frame)
+    {
+        itsLevel.resize(countLevels(frame.size()));
+        build(frame);
+        for (LinearLevel &level : itsLevel) {
+            level.itsLp.copyTo(level.itsPrior);
+            level.itsLoPass.resize(itsLoCut.size());
+            level.itsHiPass.resize(itsHiCut.size());
+            for (size_t b = 0; b < itsLoCut.size(); b++) {
+                level.itsLp.copyTo(level.itsLoPass[b]);
+                level.itsLp.copyTo(level.itsHiPass[b]);
+            }
+        }
+    }
+
+    // Filter every level but the lowpass residual, which is not
+    // amplified, for a frame seconds after the last, and shift each to
+    // its prior.
+    //
+    void filter(double seconds)
+    {
+        const size_t max = itsLevel.size() - 1;
+        for (size_t i = 0; i < max; ++i) {
+            LinearLevel &level = itsLevel[i];
+            for (size_t b = 0; b < itsLoCut.size(); b++) {
+                itsLoCut[b].pass(level.itsLoPass[b], level.itsLp, level.itsPrior, seconds);
+                itsHiCut[b].pass(level.itsHiPass[b], level.itsLp, level.itsPrior, seconds);
+            }
+            level.itsLp.copyTo(level.itsPrior);
+        }
+    }
+
+    LinearTransformState(): itsFps(0.0), itsLoCut(1, 0.0), itsHiCut(1, 0.0), itsLevel() {}
+};
+
+void LinearTransform::fps(double value) {
+    state->itsFps = value;
+    state->computeFilter();
+}
+void LinearTransform::lowCutoff(double frequency) {
+    if (frequency <= state->itsHiCut[0].itsFrequency) {
+        state->itsLoCut[0].itsFrequency = frequency;
+        state->computeFilter();
+    }
+}
+void LinearTransform::highCutoff(double frequency) {
+    if (frequency >= state->itsLoCut[0].itsFrequency) {
+        state->itsHiCut[0].itsFrequency = frequency;
+        state->computeFilter();
+    }
+}
+
+int LinearTransform::addBand(double low, double high) {
+    state->itsLoCut.push_back(LinearTemporalFilter(low));
+    state->itsHiCut.push_back(LinearTemporalFilter(high));
+    if (state->itsFps > 0) {
+        state->computeFilter();
+    }
+    itsPhaseEnergy.resize(state->itsLoCut.size(), 0.0);
+    return state->itsLoCut.size() - 1;
+}
+
+int LinearTransform::bands() const {
+    return state->itsLoCut.size();
+}
+
+LinearTransform::LinearTransform()
+    : itsFrame(), state(new LinearTransformState()), itsAlpha(0.0), itsThreshold(0.0)
+    , itsInterval(0.0), itsPhaseEnergy(1, 0.0), itsAmplitudeEnergy(0.0)
+{}
+
+LinearTransform::~LinearTransform() {}
+
+void LinearTransform::initialize(const cv::Mat &frame) {
+    static const double scaleFactor = 1.0 / 255.0;
+    frame.convertTo(itsFrame, CV_32F, scaleFactor);
+    state->initialize(itsFrame);
+}
+
+void LinearTransform::migrate(const Transform &other, const cv::Point &offset) {
+    const LinearTransform *from = dynamic_cast<const LinearTransform *>(&other);
+    if (!from) {
+        return;
+    }
+    const size_t count = std::min(state->itsLevel.size(), from->state->itsLevel.size());
+    for (size_t i = 0; i < count; ++i) {
+        const double scale = 1.0 / (1 << i);
+        const cv::Point at(cvRound(offset.x * scale), cvRound(offset.y * scale));
+        const LinearLevel &source = from->state->itsLevel[i];
+        LinearLevel &level = state->itsLevel[i];
+        copyOverlap(source.itsPrior, level.itsPrior, at);
+        const size_t bands = std::min(level.itsLoPass.size(), source.itsLoPass.size());
+        for (size_t b = 0; b < bands; b++) {
+            copyOverlap(source.itsLoPass[b], level.itsLoPass[b], at);
+            copyOverlap(source.itsHiPass[b], level.itsHiPass[b], at);
+        }
+    }
+}
+
+void LinearTransform::save(CheckpointWriter &out) const {
+    out.put((int32_t)LINEAR_TRANSFORM);
+    out.put((int32_t)state->itsLoCut.size());
+    out.put((int32_t)itsFrame.rows);
+    out.put((int32_t)itsFrame.cols);
+    out.put((int32_t)state->itsLevel.size());
+    for (const LinearLevel &level : state->itsLevel) {
+        out.put(level.itsPrior);
+        for (size_t b = 0; b < level.itsLoPass.size(); b++) {
+            out.put(level.itsLoPass[b]);
+            out.put(level.itsHiPass[b]);
+        }
+    }
+}
+
+bool LinearTransform::restore(CheckpointReader &in) {
+    const size_t bands = state->itsLoCut.size();
+    if (in.getInt() != LINEAR_TRANSFORM || in.getInt() != (int)bands) {
+        return false;
+    }
+    const int rows = in.getInt();
+    const int cols = in.getInt();
+    const int count = in.getInt();
+    if (rows <= 0 || rows > CHECKPOINT_MAX_SIDE || cols <= 0 || cols > CHECKPOINT_MAX_SIDE
+        || count != LinearTransformState::countLevels(cv::Size(cols, rows)) || count <= 0) {
+        return false;
+    }
+    // Every level is half the size of the one below, as build() makes it.
+    state->itsLevel.resize(count);
+    cv::Size size(cols, rows);
+    for (LinearLevel &level : state->itsLevel) {
+        in.get(level.itsPrior, size, CV_32F);
+        level.itsLoPass.resize(bands);
+        level.itsHiPass.resize(bands);
+        for (size_t b = 0; b < bands; b++) {
+            in.get(level.itsLoPass[b], size, CV_32F);
+            in.get(level.itsHiPass[b], size, CV_32F);
+        }
+        size = cv::Size((1 + size.width) / 2, (1 + size.height) / 2);
+    }
+    if (!in.ok()) {
+        state->itsLevel.clear();
+        return false;
+    }
+    itsFrame.create(rows, cols, CV_32F);
+    return true;
+}
+
+cv::Size LinearTransform::size() const {
+    return itsFrame.size();
+}
+
+cv::Mat LinearTransform::transform(const cv::Mat &frame) {
+    static const double scaleFactor = 1.0 / 255.0;
+
+    frame.convertTo(itsFrame, CV_32F, scaleFactor);
+    cv::Mat result;
+
+    if (state->itsLevel.empty()) {
+        state->initialize(itsFrame);
+        frame.copyTo(result);
+        return result;
+    }
+
+    state->build(itsFrame);
+    state->filter(itsInterval);
+
+    // The finest level is mostly noise, so it is left alone.
+    const float limit = itsThreshold / 100.0;
+    const int max = state->itsLevel.size() - 1;
+    cv::Mat collapsed = state->itsLevel[max].itsLp;
+    for (int i = max - 1; i >= 0; --i) {
+        LinearLevel &level = state->itsLevel[i];
+        if (i > 0) {
+            const int N = level.itsLp.rows * level.itsLp.cols;
+            float * __restrict const lpData = level.itsLp.ptr<float>(0);
+            const float * __restrict const loData = level.itsLoPass[0].ptr<float>(0);
+            const float * __restrict const hiData = level.itsHiPass[0].ptr<float>(0);
+            for (int j = 0; j < N; j++) {
+                float change = itsAlpha * (hiData[j] - loData[j]);
+                change = std::max(-limit, std::min(limit, change));
+                lpData[j] += change;
+            }
+        }
+        cv::Mat up; cv::pyrUp(collapsed, up, level.itsLp.size());
+        collapsed = up + level.itsLp;
+    }
+    collapsed.convertTo(result, CV_8UC1, 255);
+    return result;
+}
+
+void LinearTransform::measure(const cv::Mat &frame) {
+    static const double scaleFactor = 1.0 / 255.0;
+
+    frame.convertTo(itsFrame, CV_32F, scaleFactor);
+    std::fill(itsPhaseEnergy.begin(), itsPhaseEnergy.end(), 0.0);
+    itsAmplitudeEnergy = 0.0;
+
+    if (state->itsLevel.empty()) {
+        state->initialize(itsFrame);
+        return;
+    }
+
+    state->build(itsFrame);
+    state->filter(itsInterval);
+
+    const size_t max = state->itsLevel.size() - 1;
+    for (size_t i = 0; i < max; ++i) {
+        const LinearLevel &level = state->itsLevel[i];
+        const int N = level.itsLp.rows * level.itsLp.cols;
+        const float * __restrict const lpData = level.itsLp.ptr<float>(0);
+        double amplitudeSum = 0;
+        for (int j = 0; j < N; j++) {
+            amplitudeSum += 2 * lpData[j] * lpData[j];
+        }
+        itsAmplitudeEnergy += amplitudeSum;
+        for (size_t b = 0; b < itsPhaseEnergy.size(); b++) {
+            const float * __restrict const loData = level.itsLoPass[b].ptr<float>(0);
+            const float * __restrict const hiData = level.itsHiPass[b].ptr<float>(0);
+            double phaseSum = 0;
+            for (int j = 0; j < N; j++) {
+                const float change = hiData[j] - loData[j];
+                phaseSum += change * change;
+            }
+            itsPhaseEnergy[b] += phaseSum;
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef LINEAR_TRANSFORM_H_INCLUDED
+#define LINEAR_TRANSFORM_H_INCLUDED
+
+/**
+ * This file is released is under the Patented Algorithm with Software released
+ * Agreement. See LICENSE.md for more information, and view the original repo
+ * at https://github.com/tbl3rd/Pyramids
+ */
+
+#include <opencv2/opencv.hpp>
+#include <memory>
+#include <vector>
+
+#include "Transform.hpp"
+
+struct LinearTransformState;
+
+// Linear Eulerian video magnification, after Wu et al.: bandpass each
+// level of a Laplacian pyramid in time and add it back amplified. No Riesz
+// transform, phase unwrapping or trigonometry, so it costs a fraction of
+// a RieszTransform, but it amplifies noise along with motion.
+//
+class LinearTransform: public Transform {
+
+    LinearTransform &operator=(const LinearTransform &) = delete;
+    LinearTransform(const LinearTransform &) = delete;
+
+    cv::Mat itsFrame;
+    std::unique_ptr<LinearTransformState> state;
+    double itsAlpha;
+    double itsThreshold;
+    double itsInterval;                // seconds since the last frame, or 0
+    std::vector<double> itsPhaseEnergy;  // of each band
+    double itsAmplitudeEnergy;
+
+public:
+    void initialize(const cv::Mat &frame) override;
+
+    // Take the pyramid and filter state of another LinearTransform.
+    //
+    void migrate(const Transform &from, const cv::Point &offset) override;
+
+    cv::Size size() const override;
+
+    void fps(double fps) override;
+    void lowCutoff(double frequency) override;
+    void highCutoff(double frequency) override;
+    int addBand(double low, double high) override;
+    int bands() const override;
+    void interval(double seconds) override { itsInterval = seconds; }
+    void alpha(int value) override    { itsAlpha = value; }
+
+    // Truncate the amplified change of each pixel to t % of full scale.
+    //
+    void threshold(int t) override    { itsThreshold = t; }
+
+    cv::Mat transform(const cv::Mat &frame) override;
+
+    // A small motion moves a pattern of amplitude A by a change in
+    // intensity of about A times its change in phase, and the Laplacian
+    // of a pattern has half its squared amplitude on average, so this
+    // estimates the phase energy from the bandpassed intensity.
+    //
+    void measure(const cv::Mat &frame) override;
+    double phaseEnergy(int band = 0) const override { return itsPhaseEnergy[band]; }
+    double amplitudeEnergy() const override  { return itsAmplitudeEnergy; }
+
+    void save(CheckpointWriter &out) const override;
+    bool restore(CheckpointReader &in) override;
+
+    LinearTransform();
+    ~LinearTransform();
+};
+
+#endif // #ifndef LINEAR_TRANSFORM_H_INCLUDED
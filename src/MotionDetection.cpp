@@ -1,30 +1,39 @@
+#include <algorithm>
+
 #include <opencv2/opencv.hpp>
+#include "Checkpoint.hpp"
 #include "MotionDetection.hpp"
-#include <time.h>
-
-enum motionDetection_st {
-    init_st,            // enter this state while waiting for frames to settle
-    reset_st,           // re-enlarge the video and recalculate ROI
-    idle_st,            // evaluation is valid to compute from
-    monitor_motion_st,  // observe motions in several frams
-    compute_roi_st,     // occasionally recompute roi
-    valid_roi_st        // Flag a valid ROI
-} currentState = init_st;
 
 /**
- * Launch rt.transform for the given RieszTransform and the given frame.
+ * Launch rt.transform for the given Transform and the given frame.
  */
 static cv::Mat
-do_transforms(RieszTransform* rt, cv::Mat frame)
+do_transforms(Transform* rt, cv::Mat frame)
 {
     return rt->transform(frame);
 }
 
-static void debugStatePrint(void) __attribute__((unused));
+/**
+ * Initialize the given Transform for frames like the given frame.
+ */
+static cv::Mat
+do_initialize(Transform* rt, cv::Mat frame)
+{
+    rt->initialize(frame);
+    return frame;
+}
 
-static void debugStatePrint(void) {
-    static motionDetection_st previousState;
-    static bool firstPass = true;
+/**
+ * Measure the phase energy of the given frame with the given Transform.
+ */
+static cv::Mat
+do_measure(Transform* rt, cv::Mat frame)
+{
+    rt->measure(frame);
+    return frame;
+}
+
+void MotionDetection::debugStatePrint() {
     if (previousState != currentState || firstPass) {
         firstPass = false;
         previousState = currentState;
@@ -44,9 +53,6 @@ static void debugStatePrint(void) {
             case monitor_motion_st:
                 printf("monitor_motion_st\n");
                 break;
-            case valid_roi_st:
-                printf("valid_roi_st\n");
-                break;
             default:
                 printf("[error] Invalid state reached.\n");
                 break;
@@ -54,123 +60,226 @@ static void debugStatePrint(void) {
     }
 }
 
-static inline double get_time_ms() {
-	struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-
-    return ((double)(ts.tv_sec * 1000) + ts.tv_nsec / 1000000);
-}
+/**
+ * Set the pixels of mask where (|f0 - f2| & |f1 - f2|) > threshold, and
+ * return the number of pixels left set by cv::erode() with a 2x2
+ * rectangle: those set together with their neighbours above, to the left,
+ * and above left, where they exist.
+ *
+ * This is absdiff, absdiff, bitwise_and, threshold, erode and a count in
+ * one pass over the frames with no temporaries. The differences of a row
+ * are packed into the mask, which is then ANDed with the row above it
+ * and counted 64 pixels at a time while both are still in cache.
+ */
+static unsigned
+evaluateMotion(const cv::Mat &f0, const cv::Mat &f1, const cv::Mat &f2,
+               int threshold, BitMask &mask)
+{
+    const int rows = f2.rows, cols = f2.cols;
+    mask.create(rows, cols);
+    if (threshold >= 255) {
+        return 0;
+    }
+    const uchar limit = std::max(threshold, 0);
+    std::vector<uchar> changed(cols);
+    unsigned count = 0;
 
-static inline unsigned get_time_sec() {
-	struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
+    for (int y = 0; y < rows; y++) {
+        const uchar *a = f0.ptr<uchar>(y);
+        const uchar *b = f1.ptr<uchar>(y);
+        const uchar *c = f2.ptr<uchar>(y);
+        uchar *m = changed.data();
+        for (int x = 0; x < cols; x++) {
+            const uchar d1 = a[x] > c[x] ? a[x] - c[x] : c[x] - a[x];
+            const uchar d2 = b[x] > c[x] ? b[x] - c[x] : c[x] - b[x];
+            m[x] = (d1 & d2) > limit;
+        }
+        mask.setRow(y, m);
 
-    return (unsigned) ts.tv_sec;
+        // Erode this row vertically, then count it eroded horizontally,
+        // carrying the last pixel of each word into the next. Nothing
+        // left of the frame erodes the first pixel.
+        const uint64_t *words = mask.row(y);
+        const uint64_t *above = y > 0 ? mask.row(y - 1) : words;
+        uint64_t carry = 1;
+        for (int w = 0; w < mask.wordsPerRow(); w++) {
+            const uint64_t v = words[w] & above[w];
+            count += __builtin_popcountll(v & ((v << 1) | carry));
+            carry = v >> 63;
+        }
+    }
+    return count;
 }
 
 void MotionDetection::DifferentialCollins() {
-    cv::Mat h_d1;
-    cv::Mat h_d2;
-    cv::Mat eval;
-
-    // Check differences
-    // NOTE: If further optimization is necessary, we can probably hand-code this
-    // part to expose the loops to the compiler.
-    cv::absdiff(frameBuffer[0], frameBuffer[2], h_d1);
-    cv::absdiff(frameBuffer[1], frameBuffer[2], h_d2);
-    cv::bitwise_and(h_d1, h_d2, eval);
+    changedPixels = evaluateMotion(frameBuffer[0], frameBuffer[1], frameBuffer[2],
+                                   diffThreshold, evaluation);
+}
 
-    // threshold
-    cv::threshold(eval, eval, diffThreshold, 255, CV_THRESH_BINARY);
+void MotionDetection::followRawMotion(cv::Mat frame) {
+    // A single raw difference is mostly sensor noise, so the frames go
+    // through the same AND and erode as the magnified ones, and nothing
+    // moves until there are three of the same size.
+    if (rawCount > 0 && rawFrames[rawCount - 1].size() != frame.size()) {
+        rawCount = 0;
+    }
+    if (rawCount == 3) {
+        cv::Mat oldest = rawFrames[0];
+        rawFrames[0] = rawFrames[1];
+        rawFrames[1] = rawFrames[2];
+        rawFrames[2] = oldest;
+        rawCount--;
+    }
+    frame.copyTo(rawFrames[rawCount++]);
+    unsigned changed = 0;
+    if (rawCount == 3) {
+        changed = evaluateMotion(rawFrames[0], rawFrames[1], rawFrames[2],
+                                 diffThreshold, rawEvaluation);
+    }
+    keepAlarm(changed >= (unsigned)pixelThreshold);
+}
 
-    // erode
-    // cv::erode(eval, eval, erodeKernel);
+void MotionDetection::keepAlarm(bool moving) {
+    if (moving) {
+        noMovementDetected = false;
+        alarming = false;
+        return;
+    }
+    checkAlarm();
+}
 
-    evaluation =  eval;
+bool MotionDetection::skipMagnification() {
+    if (magnifyInterval <= 0) {
+        return false;
+    }
+    if (currentTime < nextMagnify) {
+        return true;
+    }
+    // Keep to the rate on average, unless too far behind to catch up.
+    nextMagnify += magnifyInterval;
+    if (nextMagnify <= currentTime) {
+        nextMagnify = currentTime + magnifyInterval;
+    }
+    return false;
 }
 
 void MotionDetection::calculatePeriod() {
     // weight of the exponentially-weighted moving average. Higher ratio gives
     // more weight to more recent samples.
     const double ALPHA = 0.4;
-    static double lastTimestamp = get_time_ms();
-
-    // get time in milliseconds
-    double timestamp = get_time_ms();
+    // media time of the current frame in milliseconds
+    double timestamp = currentTime;
+    if (lastPeakTime < 0) {
+        lastPeakTime = timestamp;
+    }
 
     // amount of time that has passed between peaks
-    double period = timestamp - lastTimestamp;
+    double period = timestamp - lastPeakTime;
     // TODO: This is what is trying to deal with the bimodal nature of the Movement
     // of breathing (movement while inhale, still, movement while exhale quickly after)
     // As a side effect, this limits the maximum frequency we detect.
     if (period > 400) { // low-pass filter of peaks occuring faster than 400ms apart
         double newRate = 1.0 / (period / 1000);
         breathingRate = ALPHA * newRate + (1 - ALPHA) * breathingRate;
-        lastTimestamp = timestamp;
+        lastPeakTime = timestamp;
     }
 }
 
 void MotionDetection::soundAlarm() {
+    if (mode == BATCH_DETECTOR) {
+        return;
+    }
+
     int playing;
 
     ca_context_playing(snd_context, 0, &playing);
     if (playing == 0)
         ca_context_play(snd_context, 0, CA_PROP_EVENT_ID, "alarm-clock-elapsed", nullptr);
 
-    printf("[ERROR] >>>>>  NO MOVEMENT DETECTED!!!!!!\n\n");
+    if (name.empty()) {
+        printf("[ERROR] >>>>>  NO MOVEMENT DETECTED!!!!!!\n\n");
+    }
+    else {
+        printf("[ERROR] >>>>>  %s: NO MOVEMENT DETECTED!!!!!!\n\n", name.c_str());
+    }
 }
 
 unsigned MotionDetection::countNumChanges() {
+    // The noise was already eroded away by DifferentialCollins().
+    return followMotion(changedPixels, (int)changedPixels >= pixelThreshold);
+}
+
+unsigned MotionDetection::measurePhaseEnergy(cv::Mat frame) {
+    std::future<cv::Mat> futures[SPLIT];
+    cv::Mat in_sections[SPLIT];
+
+    setReiszInterval();
+    for (int i = 0; i < SPLIT; i++) {
+        auto rowRange = cv::Range(frame.rows * i / SPLIT, (frame.rows * (i+1) / SPLIT));
+        auto colRange = cv::Range(0, frame.cols);
+        in_sections[i] = frame(rowRange, colRange);
+        if (thread[i]) {
+            futures[i] = thread[i]->push(do_measure, rt[i].get(), in_sections[i]);
+        }
+        else {  // already on a worker of the pool, don't hop threads
+            do_measure(rt[i].get(), in_sections[i]);
+        }
+    }
+
+    // Band 0 is the magnified one, the others extras.
+    std::vector<double> phase(1 + bandMotion.size(), 0.0);
+    double amplitude = 0.0;
+    for (int i = 0; i < SPLIT; i++) {
+        if (thread[i]) {
+            futures[i].get();
+        }
+        for (size_t b = 0; b < phase.size(); b++) {
+            phase[b] += rt[i]->phaseEnergy(b);
+        }
+        amplitude += rt[i]->amplitudeEnergy();
+    }
+    for (size_t b = 1; b < phase.size(); b++) {
+        bandMotion[b - 1] = amplitude > 0 ? 1000 * std::sqrt(phase[b] / amplitude) : 0;
+    }
+    const double mrad = amplitude > 0 ? 1000 * std::sqrt(phase[0] / amplitude) : 0;
+    return followMotion(mrad, mrad >= phaseThreshold);
+}
+
+unsigned MotionDetection::followMotion(double signal, bool moving) {
     /**
-     * NOTE: We are using an exponentially-weighted moving average to smooth
-     * out the data here. Otherwise, the data has a high-frequency component
-     * that makes peak detection more difficult.
+     * NOTE: We are using an exponentially-weighted moving average (ewma) to
+     * smooth out the data here. Otherwise, the data has a high-frequency
+     * component that makes peak detection more difficult.
      */
-    static unsigned ewma = 0;
 
     // weight of the exponentially-weighted moving average. Higher ratio gives
     // more weight to more recent samples.
     const double ALPHA = 0.3;
 
-    static unsigned lastEWMA = 0;
-    static bool wasRising = true;
-
-    static unsigned lastZeroStartTime;
-    static bool noMovementDetected = false;
-
-    cv::Mat frameErode = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(2, 2));
-    // Erode the remaining noise
-    cv::erode(evaluation, evaluation, frameErode);
+    // How much of the motion must be at one frequency before the spectral
+    // estimator is trusted with the breathing rate.
+    const double SPECTRAL_CONFIDENCE = 0.5;
 
     if (currentState == idle_st) {
-        int numberOfChanges = 0;
-
-        // -----------------------------------
-        // loop over image and detect changes
-
-        for(int i = 0; i < evaluation.cols; i++)
-        {
-            for(int j = 0; j <  evaluation.rows; j++)
-            {
-                if(static_cast<int>(evaluation.at<uchar>(j,i)) == 255)
-                {
-                    numberOfChanges++;
-                }
+        if (spectrum) {
+            spectrum->add(currentTime / 1000, signal);
+            if (spectrum->confidence() >= SPECTRAL_CONFIDENCE) {
+                breathingRate = spectrum->rate();
             }
         }
-
-        static int duration = 0;
-        if (numberOfChanges >= pixelThreshold) {
+        if (moving) {
             duration++;
             if (duration >= motionDuration) {
                 // Update the moving average
-                ewma = ALPHA * (double)numberOfChanges + (1 - ALPHA) * (double)ewma;
+                ewma = ALPHA * signal + (1 - ALPHA) * (double)ewma;
 
                 // The first time a fall is detected (signifying a peak) log the
                 // time and calculate a breathing rate. Then, wait until we
                 // are rising again before looking for another fall.
                 if ((ewma < lastEWMA) && wasRising) {
-                    calculatePeriod();
+                    if (!spectrum) {
+                        calculatePeriod();
+                    }
                     wasRising = false;
                 }
                 else if ((ewma > lastEWMA) && !wasRising) {
@@ -178,6 +287,7 @@ unsigned MotionDetection::countNumChanges() {
                 }
                 lastEWMA = ewma;
                 noMovementDetected = false;
+                alarming = false;
                 return ewma;
             }
         }
@@ -187,22 +297,30 @@ unsigned MotionDetection::countNumChanges() {
             }
         }
     }
+    checkAlarm();
+    return 0;
+}
+
+void MotionDetection::checkAlarm() {
     if (noMovementDetected) {
-        unsigned timestamp = get_time_sec();
-        unsigned elapsedTime = timestamp - lastZeroStartTime;
-        // printf("[info]    lastZeroStartTime: %u\n", lastZeroStartTime);
-        // printf("[info]    timestamp:         %u\n", timestamp);
-        // printf("[info]    elapsedTime:       %u\n", elapsedTime);
+        double timestamp = currentTime / 1000;
+        double elapsedTime = timestamp - lastZeroStartTime;
+        // printf("[info]    lastZeroStartTime: %f\n", lastZeroStartTime);
+        // printf("[info]    timestamp:         %f\n", timestamp);
+        // printf("[info]    elapsedTime:       %f\n", elapsedTime);
         if (elapsedTime >= timeToAlarm) {
+            if (!alarming) {
+                alarmCount++;
+            }
+            alarming = true;
             soundAlarm();
         }
     }
     else {
         noMovementDetected = true;
-        lastZeroStartTime = get_time_sec();
-        // printf("[info]    lastZeroStartTime: %u\n", lastZeroStartTime);
+        lastZeroStartTime = currentTime / 1000;
+        // printf("[info]    lastZeroStartTime: %f\n", lastZeroStartTime);
     }
-    return 0;
 }
 
 double MotionDetection::getBreathingRate() {
@@ -210,26 +328,33 @@ double MotionDetection::getBreathingRate() {
 }
 
 cv::Mat MotionDetection::magnifyVideo(cv::Mat frame) {
-    static cv::Mat result;
+    cv::Mat result;
 
     // Split a single 640 x 480 frame into equal sections, 1 section
     // for each thread to process
     // Run each transform independently.
-    static std::future<cv::Mat> futures[SPLIT];
-    static cv::Mat in_sections[SPLIT];
-    static cv::Mat out_sections[SPLIT];
-
+    std::future<cv::Mat> futures[SPLIT];
+    cv::Mat in_sections[SPLIT];
+    cv::Mat out_sections[SPLIT];
 
+    setReiszInterval();
     for (int i = 0; i < SPLIT; i++) {
         auto rowRange = cv::Range(frame.rows * i / SPLIT, (frame.rows * (i+1) / SPLIT));
         auto colRange = cv::Range(0, frame.cols);
         in_sections[i] = frame(rowRange, colRange);
-        futures[i] = thread[i].push(do_transforms, &rt[i], in_sections[i]);
+        if (thread[i]) {
+            futures[i] = thread[i]->push(do_transforms, rt[i].get(), in_sections[i]);
+        }
+        else {  // already on a worker of the pool, don't hop threads
+            out_sections[i] = do_transforms(rt[i].get(), in_sections[i]);
+        }
     }
 
     // recombine results and output
     for (int i = 0; i < SPLIT; i++) {
-        out_sections[i] = futures[i].get();
+        if (thread[i]) {
+            out_sections[i] = futures[i].get();
+        }
     }
     cv::vconcat(out_sections, 3, result);
 
@@ -241,139 +366,371 @@ cv::Mat MotionDetection::magnifyVideo(cv::Mat frame) {
 }
 
 void MotionDetection::monitorMotion() {
+    if (tiles) {
+        if (currentState == reset_st) {
+            tiles->clear();
+        }
+        else {
+            tiles->add(currentTime / 1000, evaluation);
+        }
+        return;
+    }
     if (currentState == reset_st) {
-        accumulator = cv::Mat::zeros(frameHeight, frameWidth, CV_8UC1);
+        accumulator.create(frameHeight, frameWidth);
         return;
     }
     // Bitwise OR all the frames in the window to aggregate motion
-    cv::bitwise_or(evaluation, accumulator, accumulator);
+    accumulator |= evaluation;
+}
+
+// Add region to others unless it is empty or overlaps first or others.
+//
+static void
+addRegion(std::vector<cv::Rect> &others, const cv::Rect &first, const cv::Rect &region)
+{
+    if (region.area() == 0 || (region & first).area() > 0) {
+        return;
+    }
+    for (const cv::Rect &other : others) {
+        if ((region & other).area() > 0) {
+            return;
+        }
+    }
+    others.push_back(region);
 }
 
-void MotionDetection::calculateROI() {
-    static int prevArea = frameWidth * frameHeight / 3;
+MotionDetection::roi_choice
+MotionDetection::calculateROIOn(const MotionDetection *md, BitMask mask,
+                                cv::Rect current, int area) {
+    return md->calculateROI(mask, current, area);
+}
 
+MotionDetection::roi_choice
+MotionDetection::calculateROI(BitMask mask, cv::Rect current, int area) const {
     // Erode the remaining noise
-    cv::erode(accumulator, accumulator, erodeKernel);
+    mask.erode(erodeDimension);
 
     // Dialate the remaining signal
-    cv::dilate(accumulator, accumulator, dilateKernel);
+    mask.dilate(dilateDimension);
 
     // NOTE: Uncomment this to view what the post-dilation view looks like
-    if (showDiff) {
-        cv::imshow("Accumulator", accumulator);
+    if (showDiff) {     // never on roiThread
+        cv::Mat maskFrame;
+        mask.toMat(maskFrame);
+        cv::imshow("Accumulator", maskFrame);
         cv::waitKey(0);
         cv::destroyAllWindows();
     }
 
-    // Create bitmask
-    cv::Mat maskFrame = accumulator > 200;
-
+    // Find the largest blob of motion straight from the bits
     int largestArea = 0;
-    int largestContour = 0;
-    std::vector<std::vector<cv::Point>> contours;
-    findContours(maskFrame, contours, cv::noArray(), CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE);
+    int largestComponent = 0;
+    const std::vector<BitMaskComponent> components = mask.components();
 
-    for(unsigned int i = 0; i < contours.size(); i++ ) {
-        int area = (int) (cv::contourArea(contours[i], false) + 0.5); // + 0.5 for rounding
-        if(area > largestArea) {
-            largestArea = area;
-            largestContour = i;
+    for(unsigned int i = 0; i < components.size(); i++ ) {
+        int blobArea = components[i].area;
+        if(blobArea > largestArea) {
+            largestArea = blobArea;
+            largestComponent = i;
         }
     }
 
-    if (contours.empty()) {
-        printf("[info] Hmmm...didn't see any motion....\n");
+    if (components.empty()) {
+        return fitROI(cv::Rect(), 0, current, area);
+    }
+    roi_choice result = fitROI(components[largestComponent].bounds, largestArea, current, area);
+
+    // The next largest blobs are other regions, each fitted as the first
+    // crop would be.
+    std::vector<BitMaskComponent> others(components);
+    std::sort(others.begin(), others.end(),
+              [](const BitMaskComponent &a, const BitMaskComponent &b) { return a.area > b.area; });
+    for (const BitMaskComponent &other : others) {
+        if ((int)result.others.size() + 1 >= maxRegions
+            || other.area < largestArea * REGION_FRACTION) {
+            break;
+        }
+        int otherArea = other.area;
+        addRegion(result.others, result.roi, sizeROI(other.bounds, otherArea));
+    }
+    return result;
+}
+
+MotionDetection::roi_choice
+MotionDetection::fitROI(cv::Rect result, int largestArea, cv::Rect current, int area) const {
+    if (largestArea == 0) {
+        if (!quiet) {
+            printf("[info] Hmmm...didn't see any motion....\n");
+        }
         // If the ROI has been cropped before, just use that same one
         // otherwise, go ahead and just choose a crop for now.
-        if ((roi.width * roi.height) > (frameWidth * frameHeight / 3)) {
-            printf("[info] Choosing an arbitrary crop for now.\n");
+        if ((current.width * current.height) > (frameWidth * frameHeight / 3)) {
+            if (!quiet) {
+                printf("[info] Choosing an arbitrary crop for now.\n");
+            }
             // Case where it's never been cropped just get a crop at (0,0)
             // In the future, could center this or something.
-            roi = cv::Rect(0, 0, frameWidth/3, frameHeight/3);
+            current = cv::Rect(0, 0, frameWidth/3, frameHeight/3);
         }
-        return;
+        return roi_choice{current, area, {}};
     }
     else {
-        cv::Rect result = cv::boundingRect(contours[largestContour]);;
-        // NOTE: Add smoothing function here. We want to enforce some size
-        // constrainst and not allow HUGE changes in frame size (which would
-        // indicate a bad read, and that we should just stay the same until
-        // next read).
-        if (largestArea >= frameWidth * frameHeight / 3) {
-            // NOTE: Just trying to crop down in a reasonable way. Making
-            // a 90k pixel square centered on the geometric center of the
-            // original bounding rect.
-            int c_x = result.x + result.width/2;
-            int c_y = result.y + result.height/2;
-
-            // make sure the roi is inside the image
-            const int target_dim = 300;
-            cv::Rect target_roi = cv::Rect(c_x - 150, c_y - 150, target_dim, target_dim);
-            bool is_inside = (target_roi & cv::Rect(0, 0, accumulator.cols, accumulator.rows)) == target_roi;
-            if (is_inside) {
-                result = target_roi;
+        result = sizeROI(result, largestArea);
+
+        // std::cout << result << std::endl;
+
+        // Smooth the changes, if any. No changes greather than 30%
+        if (std::abs(largestArea - area) * 100 / area <= 80) {
+            area = largestArea;
+            current = result;
+        }
+    }
+    return roi_choice{current, area, {}};
+}
+
+cv::Rect
+MotionDetection::sizeROI(cv::Rect result, int &largestArea) const {
+    // NOTE: Add smoothing function here. We want to enforce some size
+    // constrainst and not allow HUGE changes in frame size (which would
+    // indicate a bad read, and that we should just stay the same until
+    // next read).
+    if (largestArea >= frameWidth * frameHeight / 3) {
+        // NOTE: Just trying to crop down in a reasonable way. Making
+        // a 90k pixel square centered on the geometric center of the
+        // original bounding rect.
+        int c_x = result.x + result.width/2;
+        int c_y = result.y + result.height/2;
+
+        // make sure the roi is inside the image
+        const int target_dim = 300;
+        cv::Rect target_roi = cv::Rect(c_x - 150, c_y - 150, target_dim, target_dim);
+        bool is_inside = (target_roi & cv::Rect(0, 0, frameWidth, frameHeight)) == target_roi;
+        if (is_inside) {
+            result = target_roi;
+        }
+        else {
+            // [info] prevArea: 102400, largestArea: 105572
+            // [200 x 200 from (484, 302)]
+            if (target_roi.x + target_roi.width > frameWidth) {
+                target_roi.x -= target_roi.x + target_roi.width - frameWidth;
             }
-            else {
-                // [info] prevArea: 102400, largestArea: 105572
-                // [200 x 200 from (484, 302)]
-                if (target_roi.x + target_roi.width > frameWidth) {
-                    target_roi.x -= target_roi.x + target_roi.width - frameWidth;
-                }
-                if (target_roi.y + target_roi.height > frameHeight) {
-                    target_roi.y -= target_roi.y + target_roi.height - frameHeight;
-                }
-                if (target_roi.x < 0) {
-                    target_roi.x = 0;
-                }
-                if (target_roi.y < 0) {
-                    target_roi.y = 0;
-                }
+            if (target_roi.y + target_roi.height > frameHeight) {
+                target_roi.y -= target_roi.y + target_roi.height - frameHeight;
             }
-            result = target_roi;
-            largestArea = target_dim * target_dim;
-        }
-        else if (largestArea <= frameWidth * frameHeight / 20) {
-            // TODO: Too small, enlarging it slightly around the geometric center
-            int c_x = result.x + result.width/2;
-            int c_y = result.y + result.height/2;
-            result = cv::Rect(c_x - 100, c_y - 100, 200, 200);
-
-            // make sure the roi is inside the image
-            const int target_dim = 200;
-            cv::Rect target_roi = cv::Rect(c_x - 150, c_y - 150, target_dim, target_dim);
-            bool is_inside = (target_roi & cv::Rect(0, 0, accumulator.cols, accumulator.rows)) == target_roi;
-            if (is_inside) {
-                result = target_roi;
+            if (target_roi.x < 0) {
+                target_roi.x = 0;
             }
-            else {
-                // [info] prevArea: 102400, largestArea: 105572
-                // [200 x 200 from (484, 302)]
-                if (target_roi.x + target_roi.width > frameWidth) {
-                    target_roi.x -= target_roi.x + target_roi.width - frameWidth;
-                }
-                if (target_roi.y + target_roi.height > frameHeight) {
-                    target_roi.y -= target_roi.y + target_roi.height - frameHeight;
-                }
-                if (target_roi.x < 0) {
-                    target_roi.x = 0;
-                }
-                if (target_roi.y < 0) {
-                    target_roi.y = 0;
-                }
+            if (target_roi.y < 0) {
+                target_roi.y = 0;
             }
+        }
+        result = target_roi;
+        largestArea = target_dim * target_dim;
+    }
+    else if (largestArea <= frameWidth * frameHeight / 20) {
+        // TODO: Too small, enlarging it slightly around the geometric center
+        int c_x = result.x + result.width/2;
+        int c_y = result.y + result.height/2;
+        result = cv::Rect(c_x - 100, c_y - 100, 200, 200);
 
+        // make sure the roi is inside the image
+        const int target_dim = 200;
+        cv::Rect target_roi = cv::Rect(c_x - 150, c_y - 150, target_dim, target_dim);
+        bool is_inside = (target_roi & cv::Rect(0, 0, frameWidth, frameHeight)) == target_roi;
+        if (is_inside) {
             result = target_roi;
-            largestArea = target_dim * target_dim;
+        }
+        else {
+            // [info] prevArea: 102400, largestArea: 105572
+            // [200 x 200 from (484, 302)]
+            if (target_roi.x + target_roi.width > frameWidth) {
+                target_roi.x -= target_roi.x + target_roi.width - frameWidth;
+            }
+            if (target_roi.y + target_roi.height > frameHeight) {
+                target_roi.y -= target_roi.y + target_roi.height - frameHeight;
+            }
+            if (target_roi.x < 0) {
+                target_roi.x = 0;
+            }
+            if (target_roi.y < 0) {
+                target_roi.y = 0;
+            }
         }
 
-        // std::cout << result << std::endl;
+        result = target_roi;
+        largestArea = target_dim * target_dim;
+    }
+    return result;
+}
 
-        // Smooth the changes, if any. No changes greather than 30%
-        if (std::abs(largestArea - prevArea) * 100 / prevArea <= 80) {
-            prevArea = largestArea;
-            roi = result;
+MotionDetection::roi_choice
+MotionDetection::calculateSpectralROI(cv::Rect current, int area) const {
+    const std::vector<double> energy = tiles->energy();
+    const int rows = tiles->rows();
+    const int cols = tiles->cols();
+    const double most = *std::max_element(energy.begin(), energy.end());
+    if (most <= 0.0) {
+        return fitROI(cv::Rect(), 0, current, area);
+    }
+
+    // Grow the tile breathing the most into the 8-connected tiles around
+    // it that breathe at least TILE_CLUSTER_FRACTION as much. Other
+    // regions grow likewise from the tiles left over.
+    std::vector<bool> chosen(energy.size(), false);
+    roi_choice choice{current, area, {}};
+    for (int region = 0; region < maxRegions; region++) {
+        int peak = -1;
+        for (size_t i = 0; i < energy.size(); i++) {
+            if (!chosen[i] && (peak < 0 || energy[i] > energy[peak])) {
+                peak = i;
+            }
+        }
+        if (peak < 0 || energy[peak] <= 0.0 || energy[peak] < REGION_FRACTION * most) {
+            break;
+        }
+        std::vector<int> pending(1, peak);
+        chosen[peak] = true;
+        cv::Rect result;
+        int blobArea = 0;
+        while (!pending.empty()) {
+            const int i = pending.back();
+            pending.pop_back();
+            const cv::Rect tile = tiles->tile(i / cols, i % cols);
+            result = blobArea ? (result | tile) : tile;
+            blobArea += tile.area();
+            for (int y = i / cols - 1; y <= i / cols + 1; y++) {
+                for (int x = i % cols - 1; x <= i % cols + 1; x++) {
+                    const int j = y * cols + x;
+                    if (y >= 0 && y < rows && x >= 0 && x < cols && !chosen[j]
+                        && energy[j] >= TILE_CLUSTER_FRACTION * energy[peak]) {
+                        chosen[j] = true;
+                        pending.push_back(j);
+                    }
+                }
+            }
+        }
+        if (region == 0) {
+            choice = fitROI(result, blobArea, current, area);
+        }
+        else {
+            addRegion(choice.others, choice.roi, sizeROI(result, blobArea));
+        }
+    }
+    return choice;
+}
+
+void MotionDetection::requestROI() {
+    if (tiles) {
+        // Cheap enough to need no thread.
+        std::promise<roi_choice> now;
+        now.set_value(calculateSpectralROI(roi, prevArea));
+        nextROI = now.get_future();
+    }
+    else if (roiThread) {
+        nextROI = roiThread->push(calculateROIOn, this, accumulator, roi, prevArea);
+    }
+    else {
+        std::promise<roi_choice> now;
+        now.set_value(calculateROI(accumulator, roi, prevArea));
+        nextROI = now.get_future();
+    }
+}
+
+/**
+ * If the next region of interest is ready, crop to it: the frames in the
+ * buffer are cropped along with the transforms, so that nothing needs to
+ * be refilled and the next frame is analyzed already.
+ */
+bool MotionDetection::applyROI(cv::Mat frame) {
+    if (nextROI.valid()) {
+        if (nextROI.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return false;
         }
+        chosenROI = nextROI.get();
+    }
+    const roi_choice choice = chosenROI;
+    roi = choice.roi;
+    prevArea = choice.area;
+    for (int i = 0; i < MINIMUM_FRAMES; i++) {
+        frameBuffer[i] = frameBuffer[i](roi);
     }
+    DifferentialCollins();
+    // The transforms ran on the whole frame until now.
+    reinitializeReisz(frame(roi), CROPPED_FRAME, roi.tl());
+    trackTimer = 0;
+    trackMass = BitMaskMoments();
+    placeRegions(choice.others);
+    return true;
+}
+
+void MotionDetection::placeRegions(const std::vector<cv::Rect> &others) {
+    std::vector<std::unique_ptr<MotionDetection>> placed;
+    for (size_t k = 0; k < others.size(); k++) {
+        const cv::Rect &place = others[k];
+        const auto kept = std::find(regionROIs.begin(), regionROIs.end(), place);
+        if (kept != regionROIs.end()) {
+            placed.push_back(std::move(regions[kept - regionROIs.begin()]));
+            continue;
+        }
+        // The crop is the whole frame of the region's detector.
+        CommandLine config(*regionConfig);
+        config.frameWidth = place.width;
+        config.frameHeight = place.height;
+        const std::string label = "region " + std::to_string(k + 2);
+        placed.emplace_back(new MotionDetection(config, mode == BATCH_DETECTOR ? BATCH_DETECTOR : STREAM_DETECTOR,
+                                                name.empty() ? label : name + " " + label));
+        if (!quiet) {
+            printf("[info] Monitoring %s: %d x %d from (%d, %d)\n", label.c_str(),
+                   place.width, place.height, place.x, place.y);
+        }
+    }
+    regions = std::move(placed);
+    regionROIs = others;
+}
+
+void MotionDetection::updateRegion(MotionDetection *region, cv::Mat frame, uint64_t timestamp) {
+    region->update(frame, timestamp);
+}
+
+bool MotionDetection::trackROI(cv::Mat frame) {
+    // Follow once the center of the motion is in the outer third of the
+    // crop, so the breathing seen near the middle does not jitter it.
+    const int TRACK_MARGIN = 6;
+
+    const BitMaskMoments mass = trackMass;
+    trackTimer = 0;
+    trackMass = BitMaskMoments();
+    if (mass.m00 == 0) {
+        return false;
+    }
+    int dx = (int)(mass.m10 / mass.m00) - roi.width / 2;
+    int dy = (int)(mass.m01 / mass.m00) - roi.height / 2;
+    if (std::abs(dx) <= roi.width / TRACK_MARGIN) {
+        dx = 0;
+    }
+    if (std::abs(dy) <= roi.height / TRACK_MARGIN) {
+        dy = 0;
+    }
+    cv::Rect moved = roi + cv::Point(dx, dy);
+    moved.x = std::max(0, std::min(moved.x, frameWidth - moved.width));
+    moved.y = std::max(0, std::min(moved.y, frameHeight - moved.height));
+    if (moved == roi) {
+        return true;
+    }
+    if (!quiet) {
+        printf("[info] Tracking: [%d x %d from (%d, %d)] to (%d, %d)\n",
+               roi.width, roi.height, roi.x, roi.y, moved.x, moved.y);
+    }
+    const cv::Point shift = moved.tl() - roi.tl();
+    roi = moved;
+
+    // The buffered frames are of the old crop, so start over from this one.
+    for (int i = 0; i < MINIMUM_FRAMES; i++) {
+        pushFrameBuffer(frame(roi));
+    }
+    DifferentialCollins();
+    reinitializeReisz(frame(roi), CROPPED_FRAME, shift);
+    return true;
 }
 
 void MotionDetection::pushFrameBuffer(cv::Mat newFrame) {
@@ -385,42 +742,118 @@ void MotionDetection::pushFrameBuffer(cv::Mat newFrame) {
     newFrame.copyTo(frameBuffer[MINIMUM_FRAMES-1]);
 }
 
-void MotionDetection::reinitializeReisz(cv::Mat frame, frame_size size) {
-    static cv::Mat in_sections[SPLIT];
+void MotionDetection::reinitializeReisz(cv::Mat frame, frame_size size, cv::Point shift) {
+    int oldTop[SPLIT];
+    for (int i = 0, top = 0; i < SPLIT; i++) {
+        oldTop[i] = top;
+        top += rt[i]->size().height;
+    }
+    // The spare transforms are initialized beside the old ones, then take
+    // their state from them and are swapped in. The old ones are the spares
+    // next time, and keep their memory for it.
+    if (!preparing[0].valid()) {
+        prepareReisz(frame);
+    }
+    for (int i = 0; i < SPLIT; i++) {
+        if (preparing[i].valid()) {
+            preparing[i].get();
+        }
+    }
+    for (int i = 0; i < SPLIT; i++) {
+        const int top = frame.rows * i / SPLIT;
+        for (int j = 0; j < SPLIT; j++) {
+            spare[i]->migrate(*rt[j], shift + cv::Point(0, top - oldTop[j]));
+        }
+    }
+    for (int i = 0; i < SPLIT; i++) {
+        std::swap(rt[i], spare[i]);
+    }
+    setReiszFps(size);
+}
+
+void MotionDetection::prepareReisz(cv::Mat frame) {
     for (int i = 0; i < SPLIT; i++) {
         auto rowRange = cv::Range(frame.rows * i / SPLIT, (frame.rows * (i+1) / SPLIT));
         auto colRange = cv::Range(0, frame.cols);
-        in_sections[i] = frame(rowRange, colRange);
-        rt[i].initialize(in_sections[i]);
-
-        // NOTE: If we're reading from a file, we're not dropping anything, so
-        // just read at the file's FPS (which was initialized already).
-        if (usingCamera) {
-            switch(size) {
-                case FULL_FRAME:
-                    rt[i].fps(full_fps);
-                    break;
-                case CROPPED_FRAME:
-                    rt[i].fps(crop_fps);
-                    break;
-                default:
-                    printf("[error] Invalid crop size passed in.\n");
-            }
+        cv::Mat section = frame(rowRange, colRange);
+        if (prepareThread[i]) {
+            preparing[i] = prepareThread[i]->push(do_initialize, spare[i].get(), section);
         }
         else {
-            rt[i].fps(input_fps);
+            spare[i]->initialize(section);
+        }
+    }
+}
+
+void MotionDetection::setReiszFps(frame_size size) {
+    // NOTE: If we're reading from a file, we're not dropping anything, so
+    // just read at the file's FPS (which was initialized already).
+    double fps = input_fps;
+    if (usingCamera) {
+        switch(size) {
+            case FULL_FRAME:
+                fps = full_fps;
+                break;
+            case CROPPED_FRAME:
+                fps = crop_fps;
+                break;
+            default:
+                printf("[error] Invalid crop size passed in.\n");
         }
     }
+    // Frames of the crop, or of the whole frame without cropping, are
+    // only magnified as often as magnifyInterval.
+    if ((size == CROPPED_FRAME || !crop) && magnifyInterval > 0) {
+        fps = std::min(fps, 1000 / magnifyInterval);
+    }
+    for (int i = 0; i < SPLIT; i++) {
+        rt[i]->fps(fps);
+    }
 }
 
-void MotionDetection::update(cv::Mat newFrame) {
+void MotionDetection::setReiszInterval() {
+    // 0 has the transforms assume their nominal fps.
+    const double seconds = lastFiltered < 0 ? 0.0 : (currentTime - lastFiltered) / 1000;
+    lastFiltered = currentTime;
+    for (int i = 0; i < SPLIT; i++) {
+        rt[i]->interval(std::max(0.0, seconds));
+    }
+}
+
+void MotionDetection::update(cv::Mat newFrame, uint64_t timestamp) {
     // Print states to terminal for debugging
     // debugStatePrint();
 
-    static unsigned initTimer = 0;
-    static unsigned validTimer = 0;
-    static unsigned roiTimer = 0;
-    static unsigned refillTimer = 0;
+    // All timing below runs on the media clock of the frames, so that
+    // files replayed faster than real time give the same results.
+    currentTime = timestamp / 1000.0;
+    lastMotion = 0;
+    analyzed = false;
+
+    // Everything below sees only the watched part of the frame.
+    if (exclusion) {
+        newFrame = exclusion->apply(newFrame);
+    }
+
+    // Resume from the last checkpoint rather than settle again.
+    if (restorePending) {
+        restorePending = false;
+        if (restoreCheckpoint(newFrame)) {
+            printf("[info] Resumed from %s.\n", checkpointPath.c_str());
+        }
+    }
+
+    // The other regions go on while this one is rescanned.
+    std::vector<std::future<void>> regionWork;
+    for (size_t k = 0; k < regions.size(); k++) {
+        if (regionPool) {
+            regionWork.push_back(regionPool->push(updateRegion, regions[k].get(),
+                                                  newFrame(regionROIs[k]), timestamp));
+        }
+        else {  // already on a worker of the pool, don't hop threads
+            regions[k]->update(newFrame(regionROIs[k]), timestamp);
+        }
+    }
 
     //////////////////////////////////////
     // Perform state actions first      //
@@ -435,31 +868,66 @@ void MotionDetection::update(cv::Mat newFrame) {
             pushFrameBuffer(magnifyVideo(newFrame));
             // Reset ReiszTransforms and window
             monitorMotion();
+            // Still settling: only gross motion stops the alarm clock.
+            followRawMotion(newFrame);
             break;
         case idle_st:
             validTimer++;
-            printf("[info] Pixel Movement: %d\t [info] Motion Estimate: %f Hz\n", countNumChanges(),  getBreathingRate());
+            if (skipMagnification()) {
+                // Between magnified frames, the alarm is kept on time.
+                followRawMotion(newFrame(roi));
+                break;
+            }
+            analyzed = true;
+            if (phaseEngine) {
+                // Nothing to difference: the phase already is the motion.
+                lastMotion = measurePhaseEnergy(newFrame(roi));
+                if (!quiet) {
+                    printf("[info] Phase Movement: %d\t [info] Motion Estimate: %f Hz\n", lastMotion,  getBreathingRate());
+                }
+                break;
+            }
+            lastMotion = countNumChanges();
+            if (!quiet) {
+                printf("[info] Pixel Movement: %d\t [info] Motion Estimate: %f Hz\n", lastMotion,  getBreathingRate());
+            }
             pushFrameBuffer(magnifyVideo(newFrame(roi)));
             DifferentialCollins();
+            if (track && crop) {
+                trackTimer++;
+                if (changedPixels >= (unsigned)pixelThreshold) {
+                    trackMass += evaluation.moments();
+                }
+            }
             break;
         case monitor_motion_st:
             roiTimer++;
             pushFrameBuffer(magnifyVideo(newFrame));
             DifferentialCollins();
             monitorMotion();
+            keepAlarm(changedPixels >= (unsigned)pixelThreshold);
             break;
-        case compute_roi_st: // spend 1 frame to just calculate ROI
-            calculateROI();
-            break;
-        case valid_roi_st:
-            refillTimer++;
-            pushFrameBuffer(newFrame(roi)); // flushes frameBuffer with new size
+        case compute_roi_st: // the window is over, the accumulator snapshot taken
+            // Once the roi is known, prepare the transforms for it while
+            // the old ones still magnify this frame.
+            if (nextROI.valid()
+                && nextROI.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                chosenROI = nextROI.get();
+                prepareReisz(newFrame(chosenROI.roi));
+            }
+            pushFrameBuffer(magnifyVideo(newFrame));
+            DifferentialCollins();
+            keepAlarm(changedPixels >= (unsigned)pixelThreshold);
             break;
         default:
             printf("[error] Invalid state reached.\n");
             break;
     }
 
+    for (auto &work : regionWork) {
+        work.get();
+    }
+
     //////////////////////////////////////
     // Perform state update next        //
     //////////////////////////////////////
@@ -482,10 +950,17 @@ void MotionDetection::update(cv::Mat newFrame) {
             }
             break;
         case idle_st:
+            // While tracking, only rescan the full frame once there was
+            // no motion in the crop for roi_update_interval frames.
+            if (track && crop && trackTimer >= roiWindow) {
+                if (trackROI(newFrame)) {
+                    validTimer = 0;
+                }
+            }
             if (validTimer >= roiUpdateInterval) {
                 if (crop) {
                     currentState = reset_st;
-                    reinitializeReisz(newFrame, FULL_FRAME);
+                    reinitializeReisz(newFrame, FULL_FRAME, -roi.tl());
                 }
                 else {  // if crop is false, just hang out.
                     currentState = idle_st;
@@ -495,60 +970,234 @@ void MotionDetection::update(cv::Mat newFrame) {
             break;
         case monitor_motion_st:
             if (roiTimer >= roiWindow) {
-                currentState = compute_roi_st;
+                requestROI();
+                currentState = applyROI(newFrame) ? idle_st : compute_roi_st;
                 roiTimer = 0;
             }
             break;
         case compute_roi_st:
-            currentState = valid_roi_st;
-            break;
-        case valid_roi_st:
-            if (refillTimer >= MINIMUM_FRAMES) {
+            if (applyROI(newFrame)) {
                 currentState = idle_st;
-                reinitializeReisz(newFrame(roi), CROPPED_FRAME);
-                refillTimer = 0;
             }
             break;
         default:
             printf("[error] Invalid state reached.\n");
             break;
     }
+
+    if (!checkpointPath.empty() && currentState == idle_st) {
+        if (nextCheckpoint < 0) {
+            nextCheckpoint = currentTime + checkpointInterval;
+        }
+        else if (currentTime >= nextCheckpoint) {
+            checkpoint();
+            nextCheckpoint = currentTime + checkpointInterval;
+        }
+    }
+}
+
+void MotionDetection::checkpoint() {
+    if (checkpointPath.empty() || currentState != idle_st) {
+        return;
+    }
+    CheckpointWriter out(checkpointPath);
+    out.put((int32_t)frameWidth);
+    out.put((int32_t)frameHeight);
+    out.put(exclusion ? exclusion->bounds() : cv::Rect());
+    out.put((int32_t)phaseEngine);
+    out.put((int32_t)SPLIT);
+    out.put(roi);
+    out.put((int32_t)prevArea);
+    out.put(breathingRate);
+    for (int i = 0; i < SPLIT; i++) {
+        rt[i]->save(out);
+    }
+    if (!out.commit()) {
+        printf("[error] Cannot write checkpoint %s.\n", checkpointPath.c_str());
+    }
 }
 
-MotionDetection::MotionDetection(const CommandLine &cl) {
+bool MotionDetection::restoreCheckpoint(cv::Mat frame) {
+    CheckpointReader in(checkpointPath);
+    const int width = in.getInt();
+    const int height = in.getInt();
+    const cv::Rect bounds = in.getRect();
+    const bool phase = in.getInt();
+    const int split = in.getInt();
+    const cv::Rect saved = in.getRect();
+    const int area = in.getInt();
+    const double rate = in.getDouble();
+    const cv::Rect whole(0, 0, frame.cols, frame.rows);
+    if (!in.ok() || width != frameWidth || height != frameHeight
+        || frame.cols != frameWidth || frame.rows != frameHeight
+        || bounds != (exclusion ? exclusion->bounds() : cv::Rect())
+        || phase != phaseEngine || split != SPLIT
+        || saved.area() == 0 || (saved & whole) != saved
+        || (!crop && saved != whole)) {
+        return false;
+    }
+    for (int i = 0; i < SPLIT; i++) {
+        const int rows = saved.height * (i+1) / SPLIT - saved.height * i / SPLIT;
+        if (!spare[i]->restore(in) || spare[i]->size() != cv::Size(saved.width, rows)) {
+            return false;
+        }
+    }
+
+    roi = saved;
+    prevArea = area;
+    breathingRate = rate;
+    for (int i = 0; i < SPLIT; i++) {
+        std::swap(rt[i], spare[i]);
+    }
+    setReiszFps(crop ? CROPPED_FRAME : FULL_FRAME);
+    for (int i = 0; i < MINIMUM_FRAMES; i++) {
+        pushFrameBuffer(frame(roi));
+    }
+    DifferentialCollins();
+    currentState = idle_st;
+    initTimer = 0;
+    validTimer = 0;
+    return true;
+}
+
+MotionDetection::MotionDetection(const CommandLine &cl, detector_mode detectorMode,
+                                 const std::string &streamName) {
+    currentState = init_st;
+    previousState = init_st;
+    firstPass = true;
+    initTimer = 0;
+    validTimer = 0;
+    roiTimer = 0;
+    trackTimer = 0;
+    ewma = 0;
+    lastEWMA = 0;
+    wasRising = true;
+    duration = 0;
+    lastZeroStartTime = 0.0;
+    noMovementDetected = false;
+    lastPeakTime = -1.0;
+    lastMotion = 0;
+    analyzed = false;
+    alarming = false;
+    alarmCount = 0;
+    mode = detectorMode;
+    name = streamName;
+    quiet = mode != LIVE_DETECTOR || !name.empty();
     frameCount = 0;
+    changedPixels = 0;
     diffThreshold = cl.diffThreshold;
-    showDiff = cl.showDiff;
-    showMagnification = cl.showMagnification;
+    showDiff = cl.showDiff && mode == LIVE_DETECTOR;
+    showMagnification = cl.showMagnification && mode == LIVE_DETECTOR;
+    // Someone watching the magnified video still needs it made.
+    phaseEngine = cl.engine == "phase" && !showMagnification;
+    phaseThreshold = cl.phaseThreshold;
+    bandMotion.assign(phaseEngine ? cl.extraBands.size() : 0, 0.0);
     pixelThreshold = cl.pixelThreshold;
     motionDuration = cl.motionDuration;
-    framesToSettle = cl.framesToSettle;
+    // Filters that start settled only wait for the frame buffer.
+    framesToSettle = cl.warmStart ? std::min(cl.framesToSettle, (unsigned)MINIMUM_FRAMES)
+                                  : cl.framesToSettle;
     roiUpdateInterval = cl.roiUpdateInterval;
     roiWindow = cl.roiWindow;
     crop = cl.crop;
+    track = cl.track;
     frameWidth = cl.frameWidth;
     frameHeight = cl.frameHeight;
+    if (!cl.maskImage.empty() || !cl.maskPolygon.empty()) {
+        exclusion.reset(new ExclusionMask(cv::Size(frameWidth, frameHeight), cl.tileSize,
+                                          cl.maskImage, cl.maskPolygon));
+        if (exclusion->empty()) {
+            printf("[error] The mask leaves nothing to watch, ignoring it.\n");
+            exclusion.reset();
+        }
+        else {
+            frameWidth = exclusion->bounds().width;
+            frameHeight = exclusion->bounds().height;
+        }
+    }
     breathingRate = 1.0;
+    if (cl.rateEstimator == "spectral") {
+        spectrum.reset(new SpectralRate(cl.lowCutoff, cl.highCutoff, cl.rateWindow));
+    }
+    currentTime = 0.0;
+    lastFiltered = -1.0;
+    // Only the live stream owns the checkpoint. Recordings and streams
+    // sharing a pool would resume from it and write over one another.
+    checkpointPath = mode == LIVE_DETECTOR ? cl.checkpointPath : "";
+    checkpointInterval = cl.checkpointInterval * 1000;
+    nextCheckpoint = -1.0;
+    restorePending = !checkpointPath.empty();
+    magnifyInterval = cl.magnifyFps > 0 ? 1000 / cl.magnifyFps : 0.0;
+    nextMagnify = 0.0;
+    rawCount = 0;
     full_fps = cl.full_fps;
     crop_fps = cl.crop_fps;
     input_fps = cl.input_fps;
     timeToAlarm = cl.timeToAlarm;
-    roi = cv::Rect(cv::Point(0, 0), cv::Point(cl.frameWidth, cl.frameHeight));
-    erodeKernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(cl.erodeDimension, cl.erodeDimension));
-    dilateKernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(cl.dilateDimension, cl.dilateDimension));
-    accumulator = cv::Mat::zeros(cl.frameHeight, cl.frameWidth, CV_8UC1);
-    usingCamera = (cl.cameraId >= 0);
-    ca_context_create(&snd_context);
-    ca_context_open(snd_context);
+    roi = cv::Rect(cv::Point(0, 0), cv::Point(frameWidth, frameHeight));
+    erodeDimension = cl.erodeDimension;
+    dilateDimension = cl.dilateDimension;
+    if (cl.roiMethod == "spectral") {
+        tiles.reset(new TileSpectrum(cv::Size(frameWidth, frameHeight), cl.tileSize,
+                                     cl.lowCutoff, cl.highCutoff));
+    }
+    else {
+        accumulator.create(frameHeight, frameWidth);
+    }
+    prevArea = frameWidth * frameHeight / 3;
+    usingCamera = (cl.cameraId >= 0) && mode != BATCH_DETECTOR;
+    snd_context = nullptr;
+    if (mode != BATCH_DETECTOR) {
+        ca_context_create(&snd_context);
+        ca_context_open(snd_context);
+    }
 
+    // Only the phase engine measures the extra bands.
+    CommandLine transforms(cl);
+    if (!phaseEngine) {
+        transforms.extraBands.clear();
+    }
     for (int i = 0; i < SPLIT; i++) {
-        cl.apply(rt[i]);
-        if (usingCamera) {
-            rt[i].fps(full_fps);
+        if (mode == LIVE_DETECTOR) {
+            thread[i].reset(new WorkerThread<cv::Mat, Transform*, cv::Mat>());
+            prepareThread[i].reset(new WorkerThread<cv::Mat, Transform*, cv::Mat>());
         }
-        else {
-            rt[i].fps(cl.input_fps);
+        rt[i] = transforms.makeTransform();
+        spare[i] = transforms.makeTransform();
+        double fps = usingCamera ? full_fps : cl.input_fps;
+        // Without cropping, the full frames are magnified less often.
+        if (!crop && magnifyInterval > 0) {
+            fps = std::min(fps, 1000 / magnifyInterval);
+        }
+        rt[i]->fps(fps);
+    }
+    // showDiff shows the mask while the roi is calculated, which must
+    // happen on this thread, and a batch has no frames to keep up with.
+    if (mode == LIVE_DETECTOR && !showDiff && !tiles) {
+        roiThread.reset(new WorkerThread<roi_choice, const MotionDetection*, BitMask, cv::Rect, int>());
+    }
+
+    // A region is a crop that its detector sees whole, at the crop rate.
+    maxRegions = crop ? cl.maxRegions : 1;
+    if (maxRegions > 1) {
+        regionConfig.reset(new CommandLine(cl));
+        regionConfig->crop = false;
+        regionConfig->track = false;
+        regionConfig->maxRegions = 1;
+        regionConfig->checkpointPath.clear();
+        regionConfig->maskImage.clear();
+        regionConfig->maskPolygon.clear();
+        regionConfig->full_fps = cl.crop_fps;
+        regionConfig->showDiff = false;
+        regionConfig->showMagnification = false;
+        if (mode == LIVE_DETECTOR) {
+            regionPool.reset(new WorkerPool(maxRegions - 1));
         }
+    }
+}
 
+MotionDetection::~MotionDetection() {
+    if (snd_context) {
+        ca_context_destroy(snd_context);
     }
 }
@@ -1,34 +1,101 @@
 #ifndef MOTIONDETECTION_H_INCLUDED
 #define MOTIONDETECTION_H_INCLUDED
 
+#include <chrono>
 #include <future>
+#include <memory>
+#include <stdint.h>
 #include <opencv2/opencv.hpp>
 #include <canberra.h>
 
+#include "BitMask.hpp"
 #include "CommandLine.hpp"
-#include "RieszTransform.hpp"
+#include "ExclusionMask.hpp"
+#include "SpectralRate.hpp"
+#include "TileSpectrum.hpp"
+#include "Transform.hpp"
 #include "VideoSource.hpp"
+#include "WorkerPool.hpp"
 #include "WorkerThread.hpp"
 
 #define MINIMUM_FRAMES 3
 #define SPLIT 3
 #define NSEC_PER_SEC 1000000
 
+// The part of the band power of the busiest tile that a tile next to the
+// region of interest needs to join it.
+#define TILE_CLUSTER_FRACTION 0.5
+
+// The part of the motion of the first region of interest that another
+// region needs to be monitored as well.
+#define REGION_FRACTION 0.25
+
 // Types of frame sizes for reinitializing the Riesz FPS.
 enum frame_size {
     FULL_FRAME,
     CROPPED_FRAME
 };
 
+// How a detector is driven.
+enum detector_mode {
+    LIVE_DETECTOR,      // the only stream, transforms on threads of its own
+    STREAM_DETECTOR,    // one of many streams sharing a worker pool
+    BATCH_DETECTOR      // a recording analyzed as fast as possible, silently
+};
+
 class MotionDetection {
 
 private:
+    enum motionDetection_st {
+        init_st,            // enter this state while waiting for frames to settle
+        reset_st,           // re-enlarge the video and recalculate ROI
+        idle_st,            // evaluation is valid to compute from
+        monitor_motion_st,  // observe motions in several frams
+        compute_roi_st      // keep monitoring while the roi is recomputed
+    };
+
+    // A region of interest and the area of motion it was chosen for, and
+    // the regions with less motion to monitor alongside it.
+    struct roi_choice {
+        cv::Rect roi;
+        int area;
+        std::vector<cv::Rect> others;
+    };
+
+    // State machine
+    motionDetection_st currentState;
+    motionDetection_st previousState;   // only for debugStatePrint()
+    bool firstPass;
+    unsigned initTimer;
+    unsigned validTimer;
+    unsigned roiTimer;
+    unsigned trackTimer;
+
+    // Peak detection and alarm
+    unsigned ewma;
+    unsigned lastEWMA;
+    bool wasRising;
+    int duration;
+    double lastZeroStartTime;
+    bool noMovementDetected;
+    double lastPeakTime;
+    unsigned lastMotion;
+    bool analyzed;
+    bool alarming;
+    unsigned alarmCount;
+    detector_mode mode;
+    std::string name;               // prefixes alarms of a stream
+    bool quiet;
+    int prevArea;
+
     cv::Mat frameBuffer[3];
     int frameCount;
-    cv::Mat erodeKernel;
-    cv::Mat dilateKernel;
-    cv::Mat evaluation;
-    cv::Mat accumulator;
+    int erodeDimension;
+    int dilateDimension;
+    BitMask evaluation;
+    unsigned changedPixels;         // of evaluation, after a 2x2 erode
+    BitMask accumulator;
+    std::unique_ptr<TileSpectrum> tiles; // nullptr to crop to the largest blob
     cv::Rect roi;
     double full_fps;
     double crop_fps;
@@ -38,30 +105,117 @@ private:
     bool showDiff;
     bool showMagnification;
     bool crop;
+    bool track;
+    BitMaskMoments trackMass;       // of the motion in the crop this window
     int pixelThreshold;
+    bool phaseEngine;               // detect from phase energy, not pixels
+    int phaseThreshold;
+    std::vector<double> bandMotion; // milliradians of each extra band
     int motionDuration;
-    int frameWidth;
+    int frameWidth;                 // of the watched part of the frame
     int frameHeight;
+    std::unique_ptr<ExclusionMask> exclusion; // nullptr to watch all of it
     unsigned timeToAlarm;
     unsigned framesToSettle;
     unsigned roiUpdateInterval;
     unsigned roiWindow;
     double breathingRate;
-    RieszTransform rt[SPLIT];
-    WorkerThread<cv::Mat, RieszTransform*, cv::Mat> thread[SPLIT];
+    std::unique_ptr<SpectralRate> spectrum; // nullptr to time peaks instead
+    double currentTime;             // media time of the frame in ms
+    double magnifyInterval;         // ms between magnified crops, or 0
+    double nextMagnify;             // media time of the next one in ms
+    cv::Mat rawFrames[3];           // the last frames seen between them
+    int rawCount;                   // of rawFrames filled, up to 3
+    BitMask rawEvaluation;          // of rawFrames
+    double lastFiltered;            // media time in ms of the last frame through rt, or -1
+    std::unique_ptr<Transform> rt[SPLIT];
+    std::unique_ptr<Transform> spare[SPLIT]; // the next rt, prepared on prepareThread
+    std::future<cv::Mat> preparing[SPLIT];
+    roi_choice chosenROI;           // taken from nextROI, not yet applied
+    std::unique_ptr<WorkerThread<cv::Mat, Transform*, cv::Mat>> thread[SPLIT];
+    std::unique_ptr<WorkerThread<cv::Mat, Transform*, cv::Mat>> prepareThread[SPLIT];
     ca_context *snd_context;
+    std::future<roi_choice> nextROI;
+    std::unique_ptr<WorkerThread<roi_choice, const MotionDetection*, BitMask, cv::Rect, int>> roiThread;
+
+    // Other regions
+    int maxRegions;
+    std::unique_ptr<CommandLine> regionConfig; // of the detectors below
+    std::vector<std::unique_ptr<MotionDetection>> regions;
+    std::vector<cv::Rect> regionROIs;       // the crop each of regions sees
+    std::unique_ptr<WorkerPool> regionPool; // shared by regions, if live
+
+    // Checkpoints
+    std::string checkpointPath;     // "" to keep none
+    double checkpointInterval;      // ms between checkpoints
+    double nextCheckpoint;          // media time of the next one in ms, or -1
+    bool restorePending;            // the next frame may resume a checkpoint
 
     /**
      * Use simple image diffs over 3 frames to create a black/white evaulation
-     * image where white pixels indicate pixels that have changed.
+     * image where white pixels indicate pixels that have changed, and count
+     * the changed pixels that survive a 2x2 erode into changedPixels.
      */
     void DifferentialCollins();
 
     /**
      * Erodes and dialates the motion pixels and determines where the
-     * largest area of motion is in the frame.
+     * largest area of motion is in the frame. Changes nothing, so that it
+     * can run on roiThread while frames are still being processed.
+     * @param  mask    The motion accumulated over the roi window.
+     * @param  current The region of interest now.
+     * @param  area    The area of motion current was chosen for.
+     * @return         The region of interest to use next.
      */
-    void calculateROI();
+    roi_choice calculateROI(BitMask mask, cv::Rect current, int area) const;
+    static roi_choice calculateROIOn(const MotionDetection *md, BitMask mask,
+                                     cv::Rect current, int area);
+
+    /**
+     * Determines where in the frame the motion at the breathing rate is,
+     * from the band power of each tile, as the cluster of tiles around
+     * the one with the most of it.
+     * @param  current The region of interest now.
+     * @param  area    The area of motion current was chosen for.
+     * @return         The region of interest to use next.
+     */
+    roi_choice calculateSpectralROI(cv::Rect current, int area) const;
+
+    /**
+     * Settle on a region of interest of reasonable size around result,
+     * where largestArea pixels moved, or keep current if largestArea is 0
+     * or too far from the area current was chosen for.
+     */
+    roi_choice fitROI(cv::Rect result, int largestArea, cv::Rect current, int area) const;
+
+    /**
+     * Resize result, where largestArea pixels moved, to a region of
+     * interest of reasonable size, with no smoothing against the last
+     * one, and set largestArea to its area if it was resized.
+     */
+    cv::Rect sizeROI(cv::Rect result, int &largestArea) const;
+
+    /**
+     * Start calculating the next region of interest from the accumulator,
+     * on roiThread if there is one, and crop to it once it is ready.
+     */
+    void requestROI();
+    bool applyROI(cv::Mat frame);
+
+    /**
+     * Monitor each of others with a detector of its own, which has its own
+     * transforms, breathing rate and alarm. A region that did not move
+     * keeps its detector.
+     */
+    void placeRegions(const std::vector<cv::Rect> &others);
+    static void updateRegion(MotionDetection *region, cv::Mat frame, uint64_t timestamp);
+
+    /**
+     * Move the crop toward where the motion within it was centered over
+     * the last roi window, if that drifted toward its edges.
+     * @return true if there was motion in the crop to follow.
+     */
+    bool trackROI(cv::Mat frame);
 
     /**
      * Performs video magnification based on MIT's work. Requires that the
@@ -78,14 +232,41 @@ private:
     void pushFrameBuffer(cv::Mat newFrame);
 
     /**
-     * Reset the ReiszTransforms. Uses the input frame just to get the
-     * correct sizes.
-     * @param frame Input frame to reference for sizing.
+     * Move the ReiszTransforms to a new region, carrying their state over
+     * where it overlaps the old one, so only the rest of it has to settle.
+     * Uses the spares if prepareReisz() was called for frame.
+     * @param frame Input frame of the new region.
+     * @param shift Where the new region starts in the old one.
+     */
+    void reinitializeReisz(cv::Mat frame, frame_size size, cv::Point shift);
+    void setReiszFps(frame_size size);
+
+    /**
+     * Tell the transforms how long it has been since the last frame they
+     * filtered, on the media clock, before they filter this one.
+     */
+    void setReiszInterval();
+
+    /**
+     * Start initializing the spare ReiszTransforms for frame on the
+     * prepare threads, beside the transforms of the current frame on
+     * their own threads, so that reinitializeReisz() can swap them in.
      */
-    void reinitializeReisz(cv::Mat frame, frame_size size);
+    void prepareReisz(cv::Mat frame);
 
     /**
-     * Accumulate the bitwise OR in the accumulator each time it is called.
+     * Resume from the checkpoint at checkpointPath, straight into idle_st,
+     * if it was saved for frames like frame with the same settings and
+     * exclusion mask, and for the whole frame unless cropping. Its
+     * transforms are restored into the spares and only swapped in once
+     * all of them are, so a bad checkpoint changes nothing.
+     * @return true if it was resumed.
+     */
+    bool restoreCheckpoint(cv::Mat frame);
+
+    /**
+     * Accumulate the bitwise OR in the accumulator each time it is called,
+     * or the changes of each tile in tiles.
      */
     void monitorMotion();
 
@@ -95,12 +276,70 @@ private:
      */
     unsigned countNumChanges();
 
+    /**
+     * Run the transforms over the frame as magnifyVideo() would, but
+     * without magnifying or differencing it, and return the amplitude
+     * weighted RMS change of its bandpassed phase, in milliradians, once
+     * it passes the duration and phase thresholds.
+     * @param  frame Input image to measure.
+     */
+    unsigned measurePhaseEnergy(cv::Mat frame);
+
+    /**
+     * Smooth the motion signal of the current frame, look for its peaks
+     * to estimate the breathing rate, and sound the alarm if there was
+     * no motion for too long.
+     * @param  signal How much motion there was.
+     * @param  moving Whether signal passed its threshold.
+     * @return        The smoothed signal, or 0 without motion.
+     */
+    unsigned followMotion(double signal, bool moving);
+
+    /**
+     * Return true if the crop is magnified at a rate of its own and the
+     * current frame is not due, or else schedule the next one.
+     */
+    bool skipMagnification();
+
+    /**
+     * Keep the no-motion alarm on time on a frame whose motion is not
+     * followed, from the same three-frame difference as the magnified
+     * frames take, over the last such frames. Unmagnified, it only sees
+     * gross motion, so it can stop the alarm clock, but breathing is left
+     * to the magnified frames.
+     */
+    void followRawMotion(cv::Mat frame);
+
+    /**
+     * Stop the alarm clock if moving, or else keep it running.
+     */
+    void keepAlarm(bool moving);
+
+    /**
+     * Sound the alarm once there was no motion for timeToAlarm seconds,
+     * timing from now if there was motion until now.
+     */
+    void checkAlarm();
+
     /**
      * When a peak is detected, this is called so that the times can be logged
      * to calculate the breathing rate.
      */
     void calculatePeriod();
 
+    /**
+     * If no motion is detected for a period of time, call this function to
+     * sound an alarm!
+     */
+    void soundAlarm();
+
+    /**
+     * Print the state of the state machine when it changes.
+     */
+    void debugStatePrint() __attribute__((unused));
+
+public:
+
     /**
      * Returns the current estimate breathing rate based on the pixel differences
      * over a short time history.
@@ -109,25 +348,76 @@ private:
     double getBreathingRate();
 
     /**
-     * If no motion is detected for a period of time, call this function to
-     * sound an alarm!
+     * Returns the smoothed pixel movement of the last frame, or 0 when
+     * there was none or the frame was not analyzed.
      */
-    void soundAlarm();
+    unsigned getMotion() const { return lastMotion; }
 
-public:
+    /**
+     * Returns how much of the motion is at the breathing rate, from 0 to
+     * 1, with the spectral rate estimator, or 0 without it.
+     */
+    double getRateConfidence() const { return spectrum ? spectrum->confidence() : 0.0; }
+
+    /**
+     * Returns the number of extra bands the phase engine measures, and the
+     * RMS change of phase in milliradians within band index of the last
+     * frame it measured.
+     */
+    size_t getBandCount() const { return bandMotion.size(); }
+    double getBandMotion(size_t index) const { return bandMotion[index]; }
+
+    /**
+     * Returns the number of regions monitored besides the region of
+     * interest, and the detector of the one at index.
+     */
+    size_t getRegionCount() const { return regions.size(); }
+    const MotionDetection &getRegion(size_t index) const { return *regions[index]; }
+
+    /**
+     * Returns true if the last frame was analyzed for motion, rather than
+     * spent settling or searching for the region of interest.
+     */
+    bool wasAnalyzed() const { return analyzed; }
+
+    /**
+     * Returns true while the no-motion alarm is going off, and the number
+     * of times it went off.
+     */
+    bool isAlarming() const { return alarming; }
+    unsigned getAlarmCount() const { return alarmCount; }
+
+    /**
+     * Save the region of interest, breathing rate and transforms to the
+     * checkpoint file, if there is one and a crop is being monitored, so
+     * that a restarted detector resumes from there. Other regions are not
+     * saved, and are found again at the next scan of the full frame.
+     */
+    void checkpoint();
 
     /**
      * Operates as the tick function of the state machine. Drives the state
      * machine every time a new frame is provided from the video.
-     * @param newFrame Next unprocessed video frame.
+     * @param newFrame  Next unprocessed video frame.
+     * @param timestamp Media time of the frame in microseconds.
      */
-    void update(cv::Mat newFrame);
+    void update(cv::Mat newFrame, uint64_t timestamp);
 
     /**
      * Constructor sets motion detection params based on what was provided by
-     * the user.
+     * the user. Stream and batch detectors run on the calling thread only,
+     * because the streams or the batch are spread over a worker pool, and
+     * keep their per-frame output to themselves. Only a batch detector
+     * never sounds the alarm. streamName labels the alarms of one stream
+     * among many, and a named live detector also keeps quiet.
      */
-    MotionDetection(const CommandLine &cl);
+    MotionDetection(const CommandLine &cl, detector_mode detectorMode = LIVE_DETECTOR,
+                    const std::string &streamName = "");
+
+    ~MotionDetection();
+
+    MotionDetection(const MotionDetection&) = delete;
+    MotionDetection &operator=(const MotionDetection&) = delete;
 };
 
 #endif // #ifndef MOTIONDETECTION_H_INCLUDED
@@ -0,0 +1,380 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+#include "FrameRecorder.hpp"
+#include "RawSource.hpp"
+#include "VideoSource.hpp"
+
+#define NUM_RAW_BUFFERS 4
+
+// Frames of a file mapped at once, so that multi-gigabyte files fit in
+// a 32-bit address space.
+#define RAW_WINDOW_FRAMES 32
+
+// Y4M lines longer than this are garbage rather than a header.
+#define MAX_Y4M_LINE 1024
+
+static const char Y4M_MAGIC[] = "YUV4MPEG2 ";
+static const size_t Y4M_MAGIC_SIZE = sizeof(Y4M_MAGIC) - 1;
+static const char Y4M_FRAME[] = "FRAME";
+static const size_t Y4M_FRAME_SIZE = sizeof(Y4M_FRAME) - 1;
+
+static bool
+endsWith(const std::string &s, const std::string &suffix) {
+    return s.size() >= suffix.size()
+        && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool
+RawSource::handles(const std::string &fileName, const std::string &format)
+{
+    if (format == "raw" || format == "y4m" || format == "ring")
+        return true;
+    if (format != "auto")
+        return false;
+    return fileName == "-"
+        || endsWith(fileName, ".y4m")
+        || endsWith(fileName, ".ring")
+        || endsWith(fileName, ".raw")
+        || endsWith(fileName, ".gray")
+        || endsWith(fileName, ".y8");
+}
+
+// Parse the header tags following the YUV4MPEG2 magic. Only the size,
+// frame rate and colour space matter: the latter tells how many chroma
+// bytes follow each Y plane.
+//
+void
+RawSource::parseY4mHeader(const std::string &header)
+{
+    std::string colour = "420jpeg";
+    std::istringstream tokens(header);
+    std::string token;
+    while (tokens >> token) {
+        switch (token[0]) {
+            case 'W':
+                itsWidth = atoi(token.c_str() + 1);
+                break;
+            case 'H':
+                itsHeight = atoi(token.c_str() + 1);
+                break;
+            case 'F': {
+                int num = 0, den = 0;
+                if (sscanf(token.c_str() + 1, "%d:%d", &num, &den) == 2 && num > 0 && den > 0)
+                    itsFps = (double)num / den;
+                break;
+            }
+            case 'C':
+                colour = token.substr(1);
+                break;
+            default:
+                // interlacing, aspect ratio and X extensions do not matter
+                break;
+        }
+    }
+
+    const size_t w = itsWidth, h = itsHeight;
+    const size_t cw = (w + 1) / 2, ch = (h + 1) / 2;
+    itsLumaBytes = w * h;
+    if (colour == "mono")
+        itsChromaBytes = 0;
+    else if (colour.compare(0, 3, "420") == 0)
+        itsChromaBytes = 2 * cw * ch;
+    else if (colour.compare(0, 3, "422") == 0)
+        itsChromaBytes = 2 * cw * h;
+    else if (colour == "444")
+        itsChromaBytes = 2 * w * h;
+    else
+        throw std::runtime_error("Unsupported Y4M colour space: C" + colour);
+}
+
+// Return a pointer to bytes at offset in the file, which must all be in
+// it, mapping the window around them unless it is mapped already. The
+// window before stays mapped until the next one is, so the last frame
+// handed out stays valid while the next one is read.
+//
+char *
+RawSource::mapRange(uint64_t offset, size_t bytes)
+{
+    if (!itsMapping || offset < itsMappingFirst
+        || offset + bytes > itsMappingFirst + itsMapping->size()) {
+        const uint64_t first = offset - offset % itsPageBytes;
+        const uint64_t want = std::max<uint64_t>(offset - first + bytes, itsWindowBytes);
+        itsPrevious = std::move(itsMapping);
+        // A private mapping: frames are views into the page cache, and
+        // anyone scribbling on them gets their own copy of the page.
+        itsMapping.reset(new mmap_buffer(itsFd, first, std::min(want, itsFileBytes - first),
+                                         PROT_READ | PROT_WRITE, MAP_PRIVATE));
+        madvise(itsMapping->get(), itsMapping->size(), MADV_SEQUENTIAL);
+        itsMappingFirst = first;
+    }
+    return static_cast<char *>(itsMapping->get()) + (offset - itsMappingFirst);
+}
+
+// Check the header of a ring file and find its oldest frame.
+//
+void
+RawSource::parseRingHeader()
+{
+    const uint64_t size = itsFileBytes;
+    ring_header header;
+    if (size < sizeof(header))
+        throw std::runtime_error("Truncated ring file.");
+    memcpy(&header, mapRange(0, sizeof(header)), sizeof(header));
+    if (memcmp(header.magic, RING_MAGIC, sizeof(header.magic)) != 0
+        || header.version != RING_VERSION)
+        throw std::runtime_error("Input is not a CribSense ring file.");
+    if (header.capacity == 0
+        || header.slotBytes < sizeof(uint64_t) + (uint64_t)header.width * header.height
+        || header.headerBytes > size
+        || header.capacity > (size - header.headerBytes) / header.slotBytes)
+        throw std::runtime_error("Corrupt ring file.");
+
+    itsRing = true;
+    itsWidth = header.width;
+    itsHeight = header.height;
+    itsLumaBytes = (size_t)header.width * header.height;
+    itsChromaBytes = header.slotBytes - sizeof(uint64_t) - itsLumaBytes;
+    itsOffset = header.headerBytes;
+    itsRingCapacity = header.capacity;
+    itsRingSlotBytes = header.slotBytes;
+    if (header.written > header.capacity) {
+        itsRingSlot = header.written % header.capacity;
+        itsRingLeft = header.capacity;
+    } else {
+        itsRingSlot = 0;
+        itsRingLeft = header.written;
+    }
+}
+
+RawSource::RawSource(const std::string &fileName, const std::string &format,
+                     int width, int height)
+    : itsFd(-1)
+    , itsOwnsFd(false)
+    , itsY4m(false)
+    , itsRing(false)
+    , itsWidth(width)
+    , itsHeight(height)
+    , itsLumaBytes((size_t)width * height)
+    , itsChromaBytes(0)
+    , itsFps(0.0)
+    , itsFileBytes(0)
+    , itsPageBytes(sysconf(_SC_PAGESIZE))
+    , itsWindowBytes(0)
+    , itsMapping()
+    , itsPrevious()
+    , itsMappingFirst(0)
+    , itsOffset(0)
+    , itsRingCapacity(0)
+    , itsRingSlotBytes(0)
+    , itsRingSlot(0)
+    , itsRingLeft(0)
+    , itsPool()
+    , itsNextBuffer(0)
+    , itsScratch()
+    , itsPending()
+{
+    if (fileName == "-") {
+        itsFd = STDIN_FILENO;
+    } else {
+        itsFd = open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+        if (itsFd < 0)
+            throw std::system_error(errno, std::system_category(), "Failed to open " + fileName);
+        itsOwnsFd = true;
+    }
+
+    struct stat st;
+    if (fstat(itsFd, &st) < 0)
+        throw std::system_error(errno, std::system_category());
+
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        // Sniff the start of the file. The frames are mapped once their
+        // size is known.
+        itsFileBytes = st.st_size;
+        const size_t size = std::min<uint64_t>(itsFileBytes,
+            std::max(sizeof(ring_header), Y4M_MAGIC_SIZE + MAX_Y4M_LINE + 1));
+        const char *data = mapRange(0, size);
+        const bool ring = size >= sizeof(ring_header)
+            && memcmp(data, RING_MAGIC, sizeof(ring_header().magic)) == 0;
+        if (format == "ring" || (format == "auto" && ring))
+            parseRingHeader();
+        const bool magic = size >= Y4M_MAGIC_SIZE
+            && memcmp(data, Y4M_MAGIC, Y4M_MAGIC_SIZE) == 0;
+        if (format == "y4m" && !magic)
+            throw std::runtime_error("Input is not a Y4M file.");
+        if (magic && !itsRing && format != "raw") {
+            const char *eol = static_cast<const char *>(memchr(data, '\n', size));
+            if (eol == nullptr)
+                throw std::runtime_error("Truncated Y4M header.");
+            itsY4m = true;
+            parseY4mHeader(std::string(data + Y4M_MAGIC_SIZE, eol));
+            itsOffset = eol - data + 1;
+        }
+    } else if (format == "ring") {
+        throw std::runtime_error("Ring files must be regular files.");
+    } else if (format != "raw") {
+        // Sniff the stream. If it is not Y4M, whatever was read is the
+        // start of the first headerless frame.
+        char magic[Y4M_MAGIC_SIZE];
+        const size_t got = readStreamBytes(magic, Y4M_MAGIC_SIZE);
+        if (got == Y4M_MAGIC_SIZE && memcmp(magic, Y4M_MAGIC, Y4M_MAGIC_SIZE) == 0) {
+            std::string header;
+            if (!readStreamLine(header))
+                throw std::runtime_error("Truncated Y4M header.");
+            itsY4m = true;
+            parseY4mHeader(header);
+        } else if (format == "y4m") {
+            throw std::runtime_error("Input is not a Y4M stream.");
+        } else {
+            itsPending.assign(magic, got);
+        }
+    }
+
+    if (itsWidth <= 0 || itsHeight <= 0 || itsLumaBytes == 0)
+        throw std::runtime_error("Raw input needs a valid frame size.");
+
+    itsWindowBytes = RAW_WINDOW_FRAMES * (sizeof(uint64_t) + itsLumaBytes + itsChromaBytes);
+    if (!itsMapping) {
+        for (int i = 0; i < NUM_RAW_BUFFERS; i++)
+            itsPool.push_back(cv::Mat(itsHeight, itsWidth, CV_8UC1));
+        itsScratch.resize(itsChromaBytes);
+    }
+}
+
+RawSource::~RawSource() {
+    itsMapping.reset();
+    itsPrevious.reset();
+    if (itsOwnsFd)
+        close(itsFd);
+}
+
+// Read up to count bytes from the stream, consuming any sniffed bytes
+// first. Returns less than count only at the end of the stream.
+//
+size_t
+RawSource::readStreamBytes(void *into, size_t count)
+{
+    unsigned char *out = static_cast<unsigned char *>(into);
+    size_t done = std::min(count, itsPending.size());
+    memcpy(out, itsPending.data(), done);
+    itsPending.erase(0, done);
+
+    while (done < count) {
+        const ssize_t got = ::read(itsFd, out + done, count - done);
+        if (got == 0)
+            break;
+        if (got < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::system_error(errno, std::system_category());
+        }
+        done += got;
+    }
+    return done;
+}
+
+// Read a '\n' terminated line into line, without the terminator.
+// Returns false at the end of the stream.
+//
+bool
+RawSource::readStreamLine(std::string &line)
+{
+    line.clear();
+    char c;
+    while (readStreamBytes(&c, 1) == 1) {
+        if (c == '\n')
+            return true;
+        if (line.size() >= MAX_Y4M_LINE)
+            throw std::runtime_error("Corrupt Y4M stream: line too long.");
+        line.push_back(c);
+    }
+    return !line.empty();
+}
+
+bool
+RawSource::readMapped(cv::Mat &into)
+{
+    if (itsY4m) {
+        if (itsOffset + Y4M_FRAME_SIZE > itsFileBytes)
+            return false;
+        // Map the frame along with its line, so that it is not mapped
+        // again on its own.
+        const size_t bytes = std::min<uint64_t>(itsFileBytes - itsOffset, MAX_Y4M_LINE + itsLumaBytes);
+        const char *line = mapRange(itsOffset, bytes);
+        if (memcmp(line, Y4M_FRAME, Y4M_FRAME_SIZE) != 0)
+            return false;
+        const char *eol = static_cast<const char *>(memchr(line, '\n', std::min<size_t>(bytes, MAX_Y4M_LINE)));
+        if (eol == nullptr)
+            return false;
+        itsOffset += eol - line + 1;
+    }
+    if (itsOffset + itsLumaBytes > itsFileBytes)
+        return false;
+
+    into = cv::Mat(itsHeight, itsWidth, CV_8UC1, mapRange(itsOffset, itsLumaBytes));
+    itsOffset += itsLumaBytes + itsChromaBytes;
+    return true;
+}
+
+bool
+RawSource::readRing(cv::Mat &into, uint64_t &timestamp)
+{
+    if (itsRingLeft == 0)
+        return false;
+
+    // Map whole windows of slots, as FrameRecorder writes them, so that
+    // the window does not move with every slot past the end of one.
+    const uint64_t first = itsRingSlot - itsRingSlot % RAW_WINDOW_FRAMES;
+    const uint64_t count = std::min<uint64_t>(RAW_WINDOW_FRAMES, itsRingCapacity - first);
+    char *window = mapRange(itsOffset + first * itsRingSlotBytes, count * itsRingSlotBytes);
+    char *slot = window + (itsRingSlot - first) * itsRingSlotBytes;
+    memcpy(&timestamp, slot, sizeof(timestamp));
+    into = cv::Mat(itsHeight, itsWidth, CV_8UC1, slot + sizeof(uint64_t));
+
+    itsRingSlot = (itsRingSlot + 1) % itsRingCapacity;
+    itsRingLeft--;
+    return true;
+}
+
+bool
+RawSource::readStream(cv::Mat &into)
+{
+    if (itsY4m) {
+        std::string line;
+        if (!readStreamLine(line))
+            return false;
+        if (line.compare(0, Y4M_FRAME_SIZE, Y4M_FRAME) != 0)
+            throw std::runtime_error("Corrupt Y4M stream: expected FRAME.");
+    }
+
+    cv::Mat &frame = itsPool[itsNextBuffer];
+    if (readStreamBytes(frame.data, itsLumaBytes) < itsLumaBytes)
+        return false;
+    if (itsChromaBytes > 0
+        && readStreamBytes(itsScratch.data(), itsChromaBytes) < itsChromaBytes)
+        return false;
+
+    into = frame;
+    itsNextBuffer = (itsNextBuffer + 1) % itsPool.size();
+    return true;
+}
+
+bool
+RawSource::read(cv::Mat &into, uint64_t &timestamp) {
+    timestamp = 0;
+    if (itsRing)
+        return readRing(into, timestamp);
+    return itsMapping ? readMapped(into) : readStream(into);
+}
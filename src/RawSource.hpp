@@ -0,0 +1,96 @@
+#ifndef RAW_SOURCE_H_INCLUDED
+#define RAW_SOURCE_H_INCLUDED
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+class mmap_buffer;
+
+// Reads 8-bit luma frames that were already decoded by someone else:
+// either headerless back-to-back width x height planes, or a YUV4MPEG2
+// (Y4M) stream, in which case only the Y plane of each frame is kept,
+// or a ring file written by FrameRecorder, oldest frame first.
+//
+// Regular files are memory-mapped a window of frames at a time, so that
+// files bigger than a 32-bit address space still play, and every frame
+// handed out is a cv::Mat view directly into the mapping (no copy at
+// all) that stays valid until the next read at least. Pipes, FIFOs
+// and stdin ("-") are read into a small pool of preallocated frames that
+// is recycled round-robin, so a frame stays valid for NUM_RAW_BUFFERS - 1
+// further reads.
+//
+class RawSource {
+    int itsFd;
+    bool itsOwnsFd;
+    bool itsY4m;
+    bool itsRing;
+    int itsWidth, itsHeight;
+    size_t itsLumaBytes;               // bytes of the Y plane
+    size_t itsChromaBytes;             // bytes following Y that are skipped
+    double itsFps;                     // 0 unless the stream says otherwise
+
+    uint64_t itsFileBytes;             // of a regular file
+    size_t itsPageBytes;
+    size_t itsWindowBytes;             // mapped at once, at least
+    std::unique_ptr<mmap_buffer> itsMapping;   // the window read from
+    std::unique_ptr<mmap_buffer> itsPrevious;  // the one before, still in use
+    uint64_t itsMappingFirst;          // file offset of itsMapping
+    uint64_t itsOffset;                // read position in the file
+    uint64_t itsRingCapacity;          // slots of a ring file
+    uint64_t itsRingSlotBytes;
+    uint64_t itsRingSlot;              // next slot of a ring file
+    uint64_t itsRingLeft;              // frames left in a ring file
+
+    std::vector<cv::Mat> itsPool;
+    int itsNextBuffer;
+    std::vector<unsigned char> itsScratch;
+    std::string itsPending;            // bytes sniffed before the format was known
+
+    void parseY4mHeader(const std::string &header);
+    char *mapRange(uint64_t offset, size_t bytes);
+    void parseRingHeader();
+    bool readMapped(cv::Mat &into);
+    bool readRing(cv::Mat &into, uint64_t &timestamp);
+    bool readStream(cv::Mat &into);
+    size_t readStreamBytes(void *into, size_t count);
+    bool readStreamLine(std::string &line);
+
+public:
+
+    // Return true if fileName in format ("auto", "raw", "y4m" or "ring") should
+    // be read by this rather than by cv::VideoCapture.
+    //
+    static bool handles(const std::string &fileName, const std::string &format);
+
+    // Open fileName ("-" is stdin). width and height are only used for
+    // headerless input, where format must not be "y4m".
+    //
+    RawSource(const std::string &fileName, const std::string &format,
+              int width, int height);
+
+    ~RawSource();
+
+    RawSource(const RawSource&) = delete;
+    RawSource &operator=(const RawSource&) = delete;
+
+    // Return the size of the frames from this.
+    //
+    cv::Size frameSize() const { return cv::Size(itsWidth, itsHeight); }
+
+    // Return the frame rate declared by a Y4M header, or 0.
+    //
+    double fps() const { return itsFps; }
+
+    // Point into at the next luma frame, and set timestamp to the time it
+    // was captured in microseconds, or 0 if the input does not say.
+    // Returns false at the end of the input.
+    //
+    bool read(cv::Mat &into, uint64_t &timestamp);
+};
+
+#endif // #ifndef RAW_SOURCE_H_INCLUDED
@@ -12,8 +12,29 @@
 #include "RieszTransform.hpp"
 
 #include "Butterworth.hpp"
+#include "Checkpoint.hpp"
 #include "ComplexMat.hpp"
 
+// How many pyramids of other sizes a transform keeps for reuse: enough for
+// the full frame and the crop sizes calculateROI() picks between.
+#define RIESZ_POOL_SIZE 2
+
+// Make m a size matrix of zeros, in the memory it already has if it was
+// that size before.
+//
+static void zero(cv::Mat &m, const cv::Size &size)
+{
+    m.create(size, CV_32F);
+    m.setTo(0);
+}
+
+static void copyOverlap(const std::pair<cv::Mat, cv::Mat> &from,
+                        std::pair<cv::Mat, cv::Mat> &into, const cv::Point &offset)
+{
+    copyOverlap(from.first, into.first, offset);
+    copyOverlap(from.second, into.second, offset);
+}
+
 // A low-pass or high-pass filter.
 //
 class RieszTemporalFilter {
@@ -24,35 +45,38 @@ class RieszTemporalFilter {
 public:
 
     double itsFrequency;
-    std::vector<double> itsA;
-    std::vector<double> itsB;
+    ButterworthTable itsTable;
 
-    // Compute this filter's Butterworth coefficients for the sampling
-    // frequency, fps (frames per second).
+    // Compute this filter's Butterworth coefficients for every interval
+    // around the nominal sampling frequency, fps (frames per second).
     //
-    void computeCoefficients(double halfFps)
+    void computeCoefficients(double fps)
     {
-        const double Wn = itsFrequency / halfFps;
-        butterworth(1, Wn, itsA, itsB);
+        itsTable.compute(itsFrequency, fps);
     }
 
-    void passEach(cv::Mat &result,
-                  const cv::Mat &phase,
-                  const cv::Mat &prior) const {
+    static void passEach(cv::Mat &result,
+                         const cv::Mat &phase,
+                         const cv::Mat &prior,
+                         const ButterworthTable::Coefficients &c) {
         result
-            = itsB[0] * phase
-            + itsB[1] * prior
-            - itsA[1] * result;
-        result /= itsA[0];
+            = c.b0 * phase
+            + c.b1 * prior
+            - c.a1 * result;
     }
+
+    // Filter phase, seconds after prior.
+    //
     void pass(CompExpMat &result,
               const CompExpMat &phase,
-              const CompExpMat &prior) const {
-        passEach(cos(result), cos(phase), cos(prior));
-        passEach(sin(result), sin(phase), sin(prior));
+              const CompExpMat &prior,
+              double seconds) const {
+        const ButterworthTable::Coefficients c = itsTable.at(seconds);
+        passEach(cos(result), cos(phase), cos(prior), c);
+        passEach(sin(result), sin(phase), sin(prior), c);
     }
 
-    RieszTemporalFilter(double f): itsFrequency(f), itsA(), itsB() {}
+    RieszTemporalFilter(double f): itsFrequency(f), itsTable() {}
 };
 
 // One level of a Riesz Transform (R) Laplacian Pyramid (Lp).
@@ -61,23 +85,120 @@ class RieszPyramidLevel {
 
     RieszPyramidLevel &operator=(const RieszPyramidLevel &);
 
+    // The per-level filter state of one band, maintained across frames.
+    struct Pass {
+        CompExpMat itsRealPass;
+        CompExpMat itsImagPass;
+    };
+
     cv::Mat itsLp;                     // the frame scaled to this octave
     ComplexMat itsR;                   // the transform
     CompExpMat itsPhase;               // the amplified result
-    CompExpMat itsRealPass;            // per-level filter state maintained
-    CompExpMat itsImagPass;            // across frames
+    std::vector<Pass> itsPass;         // of each band
+    cv::Mat itsCold;                   // 1 where itsPass has seen no frame
+    bool itsWarming;                   // prime() has itsCold to do
 
 public:
     // note: this will be called after the first call to build(), which
     // sets itsLp
-    void initialize() {
+    void initialize(size_t bands, bool warm) {
     	const cv::Size size = itsLp.size();
-        cos(itsPhase)    = cv::Mat::zeros(size, CV_32F);
-        sin(itsPhase)    = cv::Mat::zeros(size, CV_32F);
-        cos(itsRealPass) = cv::Mat::zeros(size, CV_32F);
-        sin(itsRealPass) = cv::Mat::zeros(size, CV_32F);
-        cos(itsImagPass) = cv::Mat::zeros(size, CV_32F);
-        sin(itsImagPass) = cv::Mat::zeros(size, CV_32F);
+        zero(cos(itsPhase),    size);
+        zero(sin(itsPhase),    size);
+        itsPass.resize(bands);
+        for (Pass &pass : itsPass) {
+            zero(cos(pass.itsRealPass), size);
+            zero(sin(pass.itsRealPass), size);
+            zero(cos(pass.itsImagPass), size);
+            zero(sin(pass.itsImagPass), size);
+        }
+        itsWarming = warm;
+        if (warm) {
+            itsCold.create(size, CV_8U);
+            itsCold.setTo(1);
+        }
+    }
+
+    // Where the filters are cold, set those of every band to the steady
+    // state for the phase of this frame, as if it had never changed, the
+    // way lfilter_zi does. Then the bandpass starts from no change rather
+    // than ringing up from zero for many frames.
+    //
+    void prime() {
+        if (!itsWarming) {
+            return;
+        }
+        for (Pass &pass : itsPass) {
+            cos(itsPhase).copyTo(cos(pass.itsRealPass), itsCold);
+            sin(itsPhase).copyTo(sin(pass.itsRealPass), itsCold);
+            cos(itsPhase).copyTo(cos(pass.itsImagPass), itsCold);
+            sin(itsPhase).copyTo(sin(pass.itsImagPass), itsCold);
+        }
+        itsCold.setTo(0);
+        itsWarming = false;
+    }
+
+    // Take the state of from where it overlaps this, with the origin of
+    // this at offset in from, after both were initialized.
+    //
+    void migrate(const RieszPyramidLevel &from, const cv::Point &offset) {
+        copyOverlap(from.itsLp,       itsLp,       offset);
+        copyOverlap(from.itsR,        itsR,        offset);
+        copyOverlap(from.itsPhase,    itsPhase,    offset);
+        const size_t bands = std::min(itsPass.size(), from.itsPass.size());
+        for (size_t b = 0; b < bands; b++) {
+            copyOverlap(from.itsPass[b].itsRealPass, itsPass[b].itsRealPass, offset);
+            copyOverlap(from.itsPass[b].itsImagPass, itsPass[b].itsImagPass, offset);
+        }
+        // What was warm in from stays warm here.
+        if (itsWarming && !from.itsCold.empty()) {
+            copyOverlap(from.itsCold, itsCold, offset);
+        }
+    }
+
+    void save(CheckpointWriter &out) const {
+        out.put(itsLp);
+        out.put(real(itsR));
+        out.put(imag(itsR));
+        out.put(cos(itsPhase));
+        out.put(sin(itsPhase));
+        out.put((int32_t)itsPass.size());
+        for (const Pass &pass : itsPass) {
+            out.put(cos(pass.itsRealPass));
+            out.put(sin(pass.itsRealPass));
+            out.put(cos(pass.itsImagPass));
+            out.put(sin(pass.itsImagPass));
+        }
+    }
+
+    // Read back what save() wrote, with every filter already warm, and
+    // return true if it is a level of size with bands bands. An empty
+    // size takes that of the level saved.
+    //
+    bool restore(CheckpointReader &in, size_t bands, cv::Size size) {
+        if (size.area() == 0) {
+            in.get(itsLp);
+            size = itsLp.size();
+        }
+        else {
+            in.get(itsLp, size, CV_32F);
+        }
+        in.get(real(itsR), size, CV_32F);
+        in.get(imag(itsR), size, CV_32F);
+        in.get(cos(itsPhase), size, CV_32F);
+        in.get(sin(itsPhase), size, CV_32F);
+        if (in.getInt() != (int)bands) {
+            return false;
+        }
+        itsPass.resize(bands);
+        for (Pass &pass : itsPass) {
+            in.get(cos(pass.itsRealPass), size, CV_32F);
+            in.get(sin(pass.itsRealPass), size, CV_32F);
+            in.get(cos(pass.itsImagPass), size, CV_32F);
+            in.get(sin(pass.itsImagPass), size, CV_32F);
+        }
+        itsWarming = false;
+        return in.ok() && itsLp.type() == CV_32F;
     }
 
     void build(const cv::Mat &octave) {
@@ -96,15 +217,58 @@ public:
         sin  ( current.itsPhase ) .copyTo( sin  ( itsPhase ));
     }
 
-    void filter(const RieszTemporalFilter& hiCut, const RieszTemporalFilter& loCut, RieszPyramidLevel& prior) {
-        hiCut.pass(itsRealPass, itsPhase, prior.itsPhase);
-        loCut.pass(itsImagPass, itsPhase, prior.itsPhase);
+    void filter(size_t band, const RieszTemporalFilter& hiCut, const RieszTemporalFilter& loCut,
+                const RieszPyramidLevel& prior, double seconds) {
+        hiCut.pass(itsPass[band].itsRealPass, itsPhase, prior.itsPhase, seconds);
+        loCut.pass(itsPass[band].itsImagPass, itsPhase, prior.itsPhase, seconds);
     }
 
     const cv::Mat& get_result() const {
         return itsLp;
     }
 
+    // Add to phase[b] the squared change of the phase bandpassed by band
+    // b weighted by the squared local amplitude, and to amplitude the
+    // weights, so that phase[b] / amplitude is their weighted mean over
+    // every level summed. The weights are the same for every band.
+    //
+    void energy(std::vector<double> &phase, double &amplitude) const {
+        const int N = itsLp.rows * itsLp.cols;
+        const float * __restrict const lpData = itsLp.ptr<float>(0);
+        const float * __restrict const realRData = real(itsR).ptr<float>(0);
+        const float * __restrict const imagRData = imag(itsR).ptr<float>(0);
+
+        double amplitudeSum = 0;
+        for (int i = 0; i < N; i++) {
+            float lp = lpData[i];
+            float realR = realRData[i];
+            float imagR = imagRData[i];
+            amplitudeSum += realR * realR + imagR * imagR + lp * lp;
+        }
+        amplitude += amplitudeSum;
+
+        for (size_t b = 0; b < itsPass.size() && b < phase.size(); b++) {
+            const float * __restrict const cosRealPassData = cos(itsPass[b].itsRealPass).ptr<float>(0);
+            const float * __restrict const sinRealPassData = sin(itsPass[b].itsRealPass).ptr<float>(0);
+            const float * __restrict const cosImagPassData = cos(itsPass[b].itsImagPass).ptr<float>(0);
+            const float * __restrict const sinImagPassData = sin(itsPass[b].itsImagPass).ptr<float>(0);
+
+            double phaseSum = 0;
+            for (int i = 0; i < N; i++) {
+                float lp = lpData[i];
+                float realR = realRData[i];
+                float imagR = imagRData[i];
+                float ampl2 = realR * realR + imagR * imagR + lp * lp;
+
+                float cosChange = cosRealPassData[i] - cosImagPassData[i];
+                float sinChange = sinRealPassData[i] - sinImagPassData[i];
+
+                phaseSum += ampl2 * (cosChange * cosChange + sinChange * sinChange);
+            }
+            phase[b] += phaseSum;
+        }
+    }
+
 private:
     static float safe_divide(float dividend, float divisor) __attribute__((always_inline)) {
         if (divisor == 0.0 || divisor == -0.0)
@@ -177,8 +341,8 @@ public:
 #endif
     }
 
-    // Multipy the phase difference in this level by alpha but only up to
-    // some ceiling threshold.
+    // Multipy the phase difference of the first band in this level by
+    // alpha but only up to some ceiling threshold.
     //
     void amplify(double alpha, double threshold) {
         static const double sigma = 3.0;
@@ -192,7 +356,7 @@ public:
         cv::Mat amplitude = square(itsR) + itsLp.mul(itsLp);
         cv::sqrt(amplitude, amplitude);
 
-        const CompExpMat change = itsRealPass - itsImagPass;
+        const CompExpMat change = itsPass[0].itsRealPass - itsPass[0].itsImagPass;
         cos(temp) = cos(change).mul(amplitude);
         sin(temp) = sin(change).mul(amplitude);
         cv::sepFilter2D(cos(temp), cos(temp), -1, kernel, kernel);
@@ -216,10 +380,10 @@ public:
         float * __restrict const lpData = itsLp.ptr<float>(0);
         const float * __restrict const realRData = real(itsR).ptr<float>(0);
         const float * __restrict const imagRData = imag(itsR).ptr<float>(0);
-        const float * __restrict const cosRealPassData = cos(itsRealPass).ptr<float>(0);
-        const float * __restrict const sinRealPassData = sin(itsRealPass).ptr<float>(0);
-        const float * __restrict const cosImagPassData = cos(itsImagPass).ptr<float>(0);
-        const float * __restrict const sinImagPassData = sin(itsImagPass).ptr<float>(0);
+        const float * __restrict const cosRealPassData = cos(itsPass[0].itsRealPass).ptr<float>(0);
+        const float * __restrict const sinRealPassData = sin(itsPass[0].itsRealPass).ptr<float>(0);
+        const float * __restrict const cosImagPassData = cos(itsPass[0].itsImagPass).ptr<float>(0);
+        const float * __restrict const sinImagPassData = sin(itsPass[0].itsImagPass).ptr<float>(0);
 
         // Note: we store the first part of the algorithm into a cv::Mat
         // to be able to run cv::sepFilter2D (which uses DFT if the kernel is
@@ -310,10 +474,14 @@ public:
         itsLevel[max].build(octave);
     }
 
-    void unwrapOrientPhase(const RieszPyramid &prior) {
+    // Sum the phase energy of each band of every level but the lowpass
+    // residual.
+    //
+    void energy(std::vector<double> &phase, double &amplitude) const
+    {
         const RieszPyramid::size_type max = itsLevel.size() - 1;
         for (RieszPyramid::size_type i = 0; i < max; ++i) {
-            itsLevel[i].unwrapOrientPhase(prior.itsLevel[i]);
+            itsLevel[i].energy(phase, amplitude);
         }
     }
 
@@ -358,16 +526,66 @@ public:
         return initialized();
     }
 
+    // Return the size of the frame this was last initialized for.
+    //
+    cv::Size size() const {
+        return itsLevel[0].get_result().size();
+    }
+
     // Initialize levels here because cannot do that through vector<>.
+    // Levels of the same size as before keep their memory.
     //
-    void initialize(const cv::Mat &frame)
+    void initialize(const cv::Mat &frame, size_t bands, bool warm)
     {
         itsLevel.resize(countLevels(frame.size()));
         build(frame);
         const size_type count = itsLevel.size();
         for (size_type i = 0; i < count; ++i) {
             RieszPyramidLevel &rpl = itsLevel[i];
-            rpl.initialize();
+            rpl.initialize(bands, warm);
+        }
+    }
+
+    void save(CheckpointWriter &out) const
+    {
+        out.put((int32_t)itsLevel.size());
+        for (const RieszPyramidLevel &rpl : itsLevel) {
+            rpl.save(out);
+        }
+    }
+
+    // Read back what save() wrote, and return true if it is a pyramid
+    // of bands bands, every level half the size of the one below.
+    //
+    bool restore(CheckpointReader &in, size_t bands)
+    {
+        const int count = in.getInt();
+        if (count <= 0 || count > 32) {
+            return false;
+        }
+        itsLevel.resize(count);
+        cv::Size size;
+        for (RieszPyramidLevel &rpl : itsLevel) {
+            if (!rpl.restore(in, bands, size)) {
+                return false;
+            }
+            size = rpl.get_result().size();
+            size = cv::Size((1 + size.width) / 2, (1 + size.height) / 2);
+        }
+        return count == countLevels(itsLevel[0].get_result().size());
+    }
+
+    // Take the state of the levels of from where they overlap these, with
+    // the origin of the frame at offset in the frame of from. Each level
+    // is half the size of the one below, and so is its offset.
+    //
+    void migrate(const RieszPyramid &from, const cv::Point &offset)
+    {
+        const size_type count = std::min(itsLevel.size(), from.itsLevel.size());
+        for (size_type i = 0; i < count; ++i) {
+            const double scale = 1.0 / (1 << i);
+            const cv::Point at(cvRound(offset.x * scale), cvRound(offset.y * scale));
+            itsLevel[i].migrate(from.itsLevel[i], at);
         }
     }
 };
@@ -382,6 +600,7 @@ class RieszTemporalBandpass {
 public:
 
     double itsFps;
+    int itsEvery;                      // frames between coarse updates
     RieszTemporalFilter itsLoCut;
     RieszTemporalFilter itsHiCut;
 
@@ -390,9 +609,19 @@ public:
     //
     void computeFilter()
     {
-        const double halfFps = itsFps / 2.0;
-        itsLoCut.computeCoefficients(halfFps);
-        itsHiCut.computeCoefficients(halfFps);
+        itsLoCut.computeCoefficients(itsFps);
+        itsHiCut.computeCoefficients(itsFps);
+    }
+
+    // Return the most frames up to every between updates at which this
+    // band is still below the Nyquist frequency.
+    //
+    int fit(int every) const
+    {
+        while (every > 1 && itsHiCut.itsFrequency >= itsFps / (2.0 * every)) {
+            every--;
+        }
+        return every;
     }
 
     void lowCutoff(double frequency) {
@@ -409,74 +638,277 @@ public:
         }
     }
 
-    // Shift the current filter state to the prior filter state.
-    // The prior itsRealPass and itsImagPass are never referenced.
+    // Filter the phase of current, the filter state of band, from prior,
+    // seconds before it.
     //
-    void shift(const RieszPyramidLevel &current, RieszPyramidLevel &prior)
+    void filterLevel(size_t band, RieszPyramidLevel &current, const RieszPyramidLevel &prior,
+                     double seconds) const
     {
-        prior.assign(current);
+        current.filter(band, itsHiCut, itsLoCut, prior, seconds);
     }
 
-    void filterLevel(RieszPyramidLevel &current, RieszPyramidLevel &prior)
+    // Take the sampling frequency, cut-offs and coefficients of that.
+    //
+    void assign(const RieszTemporalBandpass &that)
     {
-        current.filter(itsHiCut, itsLoCut, prior);
-        shift(current, prior);
-    }
-
-    void filterPyramids(RieszPyramid &current, RieszPyramid &prior)
-    {
-        assert(current.itsLevel.size() == prior.itsLevel.size());
-        const RieszPyramid::size_type count = current.itsLevel.size() - 1;
-        for (RieszPyramid::size_type i = 0; i < count; ++i) {
-            filterLevel(current.itsLevel[i], prior.itsLevel[i]);
-        }
-        shift(current.itsLevel[count], prior.itsLevel[count]);
+        itsFps = that.itsFps;
+        itsEvery = that.itsEvery;
+        itsLoCut.itsFrequency = that.itsLoCut.itsFrequency;
+        itsLoCut.itsTable = that.itsLoCut.itsTable;
+        itsHiCut.itsFrequency = that.itsHiCut.itsFrequency;
+        itsHiCut.itsTable = that.itsHiCut.itsTable;
     }
 
     RieszTemporalBandpass(const RieszTemporalBandpass &that)
         : itsFps(that.itsFps)
+        , itsEvery(that.itsEvery)
         , itsLoCut(that.itsLoCut.itsFrequency)
         , itsHiCut(that.itsHiCut.itsFrequency)
     {}
 
-    RieszTemporalBandpass() : itsFps(0.0), itsLoCut(0.0), itsHiCut(0.0) {}
+    RieszTemporalBandpass()
+        : itsFps(0.0), itsEvery(1), itsLoCut(0.0), itsHiCut(0.0)
+    {}
 };
 
 
+// The pyramids and the bands that filter them: the first is magnified,
+// the others only measured.
+//
 struct RieszTransformState {
-    RieszTemporalBandpass itsBand;
+    std::vector<std::unique_ptr<RieszTemporalBandpass>> itsBands;
     RieszPyramid itsCurrent;
     RieszPyramid itsPrior;
+    size_t itsCoarseLevels;            // updated only every itsEvery frames
+    int itsEvery;                      // as asked, before fitting the bands
+    unsigned itsFrame;                 // counts calls to filterPyramids()
+    double itsCoarseSeconds;           // since the coarse levels were updated
+    bool itsWarm;                      // prime the filters from the first frame
+
+    // Unwrap the phase of every level but the lowpass residual, filter
+    // it through every band, then shift the current filter state to the
+    // prior filter state. The pyramid is built and its phase unwrapped
+    // once for all of them, so another band costs only its temporal
+    // filters. The prior itsPass are never referenced.
+    //
+    // The frame came seconds after the last one, or at the nominal rate
+    // if that is not positive, and is filtered for that interval.
+    //
+    // The coarsest itsCoarseLevels levels are only unwrapped and filtered
+    // every itsEvery frames, against a prior that many frames old, for
+    // the time since. In between they hold their filter state, so they
+    // magnify the frame with the last change they saw.
+    //
+    void filterPyramids(double seconds)
+    {
+        assert(itsCurrent.itsLevel.size() == itsPrior.itsLevel.size());
+        const RieszPyramid::size_type count = itsCurrent.itsLevel.size() - 1;
+        const RieszPyramid::size_type fine = count - std::min(count, itsCoarseLevels);
+        const int every = itsBands[0]->itsEvery;
+        const bool coarseDue = itsFrame++ % every == 0;
+        if (seconds <= 0) {
+            seconds = 1.0 / itsBands[0]->itsFps;
+        }
+        itsCoarseSeconds += seconds;
+        for (RieszPyramid::size_type i = 0; i < count; ++i) {
+            const bool coarse = i >= fine && every > 1;
+            if (coarse && !coarseDue) {
+                continue;
+            }
+            const double interval = coarse ? itsCoarseSeconds : seconds;
+            itsCurrent.itsLevel[i].unwrapOrientPhase(itsPrior.itsLevel[i]);
+            for (size_t b = 0; b < itsBands.size(); b++) {
+                itsBands[b]->filterLevel(b, itsCurrent.itsLevel[i], itsPrior.itsLevel[i], interval);
+            }
+            itsCurrent.itsLevel[i].prime();
+            itsPrior.itsLevel[i].assign(itsCurrent.itsLevel[i]);
+        }
+        if (coarseDue) {
+            itsCoarseSeconds = 0.0;
+        }
+        itsPrior.itsLevel[count].assign(itsCurrent.itsLevel[count]);
+    }
 
-    RieszTransformState() {}
-    RieszTransformState(const RieszTransformState& other) : itsBand(other.itsBand) {
+    // Update the coarse levels as rarely as itsEvery asks, but often
+    // enough for every band, and recompute the filters for it.
+    //
+    void computeFilters()
+    {
+        int every = itsEvery;
+        for (auto &band : itsBands) {
+            every = band->fit(every);
+        }
+        for (auto &band : itsBands) {
+            band->itsEvery = every;
+            if (band->itsFps > 0) {
+                band->computeFilter();
+            }
+        }
+    }
+
+    void initialize(const cv::Mat &frame)
+    {
+        itsCurrent.initialize(frame, itsBands.size(), itsWarm);
+        itsPrior.initialize(frame, itsBands.size(), itsWarm);
+        itsFrame = 0;
+        itsCoarseSeconds = 0.0;
+    }
+
+    // Take the bands and the rates of the levels of that.
+    //
+    void assignBands(const RieszTransformState &that)
+    {
+        itsCoarseLevels = that.itsCoarseLevels;
+        itsEvery = that.itsEvery;
+        itsWarm = that.itsWarm;
+        itsBands.resize(that.itsBands.size());
+        for (size_t b = 0; b < itsBands.size(); b++) {
+            if (!itsBands[b]) {
+                itsBands[b].reset(new RieszTemporalBandpass());
+            }
+            itsBands[b]->assign(*that.itsBands[b]);
+        }
+    }
+
+    RieszTransformState()
+        : itsBands(), itsCoarseLevels(0), itsEvery(1), itsFrame(0), itsCoarseSeconds(0.0)
+        , itsWarm(false) {
+        itsBands.emplace_back(new RieszTemporalBandpass());
+    }
+    RieszTransformState(const RieszTransformState& other)
+        : itsBands(), itsCoarseLevels(0), itsEvery(1), itsFrame(0), itsCoarseSeconds(0.0)
+        , itsWarm(false) {
+        assignBands(other);
     }
 };
 
 void RieszTransform::fps(double value) {
-    state->itsBand.itsFps = value;
-    state->itsBand.computeFilter();
+    for (auto &band : state->itsBands) {
+        band->itsFps = value;
+    }
+    state->computeFilters();
 }
 void RieszTransform::lowCutoff(double frequency) {
-    state->itsBand.lowCutoff(frequency);
+    state->itsBands[0]->lowCutoff(frequency);
+    state->computeFilters();
 }
 void RieszTransform::highCutoff(double frequency) {
-    state->itsBand.highCutoff(frequency);
+    state->itsBands[0]->highCutoff(frequency);
+    state->computeFilters();
 }
 
-RieszTransform::RieszTransform() : state(new RieszTransformState()), itsAlpha(0.0), itsThreshold(0.0) {}
+void RieszTransform::decimate(int levels, int every) {
+    state->itsCoarseLevels = std::max(0, levels);
+    state->itsEvery = std::max(1, every);
+    state->computeFilters();
+}
 
-RieszTransform::RieszTransform(const RieszTransform& other) : state(new RieszTransformState(*other.state)), itsAlpha(other.itsAlpha), itsThreshold(other.itsThreshold) {
-    fps(other.state->itsBand.itsFps);
+void RieszTransform::warmStart(bool warm) {
+    state->itsWarm = warm;
+}
+
+int RieszTransform::addBand(double low, double high) {
+    std::unique_ptr<RieszTemporalBandpass> band(new RieszTemporalBandpass());
+    band->itsFps = state->itsBands[0]->itsFps;
+    band->itsLoCut.itsFrequency = low;
+    band->itsHiCut.itsFrequency = high;
+    state->itsBands.push_back(std::move(band));
+    state->computeFilters();
+    itsPhaseEnergy.resize(state->itsBands.size(), 0.0);
+    return state->itsBands.size() - 1;
+}
+
+int RieszTransform::bands() const {
+    return state->itsBands.size();
+}
+
+RieszTransform::RieszTransform() : state(new RieszTransformState()), itsAlpha(0.0), itsThreshold(0.0), itsInterval(0.0), itsPhaseEnergy(1, 0.0), itsAmplitudeEnergy(0.0) {}
+
+RieszTransform::RieszTransform(const RieszTransform& other) : state(new RieszTransformState(*other.state)), itsAlpha(other.itsAlpha), itsThreshold(other.itsThreshold), itsInterval(0.0), itsPhaseEnergy(other.itsPhaseEnergy.size(), 0.0), itsAmplitudeEnergy(0.0) {
 }
 
 RieszTransform::~RieszTransform() {}
 
+void RieszTransform::resize(const cv::Size &size) {
+    std::unique_ptr<RieszTransformState> next;
+    for (auto it = itsPool.begin(); it != itsPool.end(); ++it) {
+        if ((*it)->itsCurrent.size() == size) {
+            next = std::move(*it);
+            itsPool.erase(it);
+            break;
+        }
+    }
+    if (!next) {
+        next.reset(new RieszTransformState());
+    }
+    next->assignBands(*state);
+    itsPool.push_back(std::move(state));
+    if (itsPool.size() > RIESZ_POOL_SIZE) {
+        itsPool.erase(itsPool.begin());
+    }
+    state = std::move(next);
+}
+
 void RieszTransform::initialize(const cv::Mat& frame) {
     static const double scaleFactor = 1.0 / 255.0;
     frame.convertTo(itsFrame, CV_32F, scaleFactor);
-    state->itsCurrent.initialize(itsFrame);
-    state->itsPrior.initialize(itsFrame);
+    if (state->itsCurrent && state->itsCurrent.size() != itsFrame.size()) {
+        resize(itsFrame.size());
+    }
+    state->initialize(itsFrame);
+}
+
+void RieszTransform::migrate(const Transform &other, const cv::Point &offset) {
+    const RieszTransform *from = dynamic_cast<const RieszTransform *>(&other);
+    if (from && state->itsCurrent && from->state->itsCurrent) {
+        state->itsCurrent.migrate(from->state->itsCurrent, offset);
+        state->itsPrior.migrate(from->state->itsPrior, offset);
+    }
+}
+
+void RieszTransform::save(CheckpointWriter &out) const {
+    out.put((int32_t)RIESZ_TRANSFORM);
+    out.put((int32_t)state->itsBands.size());
+    out.put((int32_t)state->itsFrame);
+    out.put(state->itsCoarseSeconds);
+    state->itsCurrent.save(out);
+    state->itsPrior.save(out);
+}
+
+bool RieszTransform::restore(CheckpointReader &in) {
+    const size_t bands = state->itsBands.size();
+    if (in.getInt() != RIESZ_TRANSFORM || in.getInt() != (int)bands) {
+        return false;
+    }
+    state->itsFrame = in.getInt();
+    state->itsCoarseSeconds = in.getDouble();
+    if (!state->itsCurrent.restore(in, bands) || !state->itsPrior.restore(in, bands)
+        || state->itsCurrent.size() != state->itsPrior.size()) {
+        state->itsCurrent.itsLevel.clear();
+        return false;
+    }
+    itsFrame.create(state->itsCurrent.size(), CV_32F);
+    return true;
+}
+
+cv::Size RieszTransform::size() const {
+    return itsFrame.size();
+}
+
+void RieszTransform::measure(const cv::Mat &frame) {
+    static const double scaleFactor = 1.0 / 255.0;
+
+    frame.convertTo(itsFrame, CV_32F, scaleFactor);
+    std::fill(itsPhaseEnergy.begin(), itsPhaseEnergy.end(), 0.0);
+    itsAmplitudeEnergy = 0.0;
+
+    if (state->itsCurrent) {
+        state->itsCurrent.build(itsFrame);
+        state->filterPyramids(itsInterval);
+        state->itsCurrent.energy(itsPhaseEnergy, itsAmplitudeEnergy);
+    } else {
+        state->initialize(itsFrame);
+    }
 }
 
 cv::Mat RieszTransform::transform(const cv::Mat &frame) {
@@ -488,14 +920,12 @@ cv::Mat RieszTransform::transform(const cv::Mat &frame) {
 
     if (state->itsCurrent) {
         state->itsCurrent.build(itsFrame);
-        state->itsCurrent.unwrapOrientPhase(state->itsPrior);
-        state->itsBand.filterPyramids(state->itsCurrent, state->itsPrior);
+        state->filterPyramids(itsInterval);
         state->itsCurrent.amplify(itsAlpha, itsThreshold * PI_PERCENT);
         itsFrame = state->itsCurrent.collapse();
         itsFrame.convertTo(result, CV_8UC1, 255);
     } else {
-        state->itsCurrent.initialize(itsFrame);
-        state->itsPrior.initialize(itsFrame);
+        state->initialize(itsFrame);
         frame.copyTo(result);
     }
 
@@ -9,41 +9,77 @@
 
 #include <opencv2/opencv.hpp>
 #include <memory>
+#include <vector>
+
+#include "Transform.hpp"
 
 struct RieszTransformState;
 
-class RieszTransform {
+class RieszTransform: public Transform {
 
     RieszTransform &operator=(const RieszTransform &) = delete;
 
     cv::Mat itsFrame;
     std::unique_ptr<RieszTransformState> state;
+    std::vector<std::unique_ptr<RieszTransformState>> itsPool; // other sizes
     double itsAlpha;
     double itsThreshold;
+    double itsInterval;                // seconds since the last frame, or 0
+    std::vector<double> itsPhaseEnergy;  // of each band
+    double itsAmplitudeEnergy;
+
+    // Switch state to pyramids of frames of size, from itsPool if it has
+    // them, keeping the old ones there.
+    //
+    void resize(const cv::Size &size);
 
 public:
-    void initialize(const cv::Mat &frame);
+    // Start over on frames like frame, in the memory of the last frames
+    // that size if there were any.
+    //
+    void initialize(const cv::Mat &frame) override;
+
+    // Take the pyramids and filter state of another RieszTransform.
+    //
+    void migrate(const Transform &from, const cv::Point &offset) override;
 
-    // Set the frames per second which is the filter sampling frequency.
+    cv::Size size() const override;
+
+    void fps(double fps) override;
+    void lowCutoff(double frequency) override;
+    void highCutoff(double frequency) override;
+
+    // The bands share the pyramids and the unwrapped phase of each frame.
     //
-    void fps(double fps);
+    int addBand(double low, double high) override;
+    int bands() const override;
 
-    // Set the low or high cut-off frequency of the bandpass filter.
+    // Unwrap and filter the coarsest levels only every every frames.
     //
-    void lowCutoff(double frequency);
-    void highCutoff(double frequency);
+    void decimate(int levels, int every) override;
+
+    void interval(double seconds) override { itsInterval = seconds; }
 
-    // Set the amplification (alpha parameter) to value.
+    // Prime each level from the phase of the first frame it filters.
     //
-    void alpha(int value)             { itsAlpha = value; }
+    void warmStart(bool warm) override;
 
-    // Truncate the maximum phase difference to t.
+    void alpha(int value) override    { itsAlpha = value; }
+
+    // Truncate the maximum phase difference to t as % of pi.
     //
-    void threshold(int t)             { itsThreshold = t; }
+    void threshold(int t) override    { itsThreshold = t; }
+
+    cv::Mat transform(const cv::Mat &frame) override;
 
-    // Return copy of frame with motion magnified.
+    // Measure the bandpassed change in phase itself.
     //
-    cv::Mat transform(const cv::Mat &frame);
+    void measure(const cv::Mat &frame) override;
+    double phaseEnergy(int band = 0) const override { return itsPhaseEnergy[band]; }
+    double amplitudeEnergy() const override  { return itsAmplitudeEnergy; }
+
+    void save(CheckpointWriter &out) const override;
+    bool restore(CheckpointReader &in) override;
 
     RieszTransform();
     RieszTransform(const RieszTransform&);
@@ -0,0 +1,182 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <new>
+#include <stdexcept>
+#include <system_error>
+
+#include "SharedFrameRing.hpp"
+#include "VideoSource.hpp"
+
+// How long next() sleeps before looking at the counters again.
+#define RING_POLL_MS 100
+
+static inline uint64_t
+roundUp(uint64_t bytes, uint64_t multiple) {
+    return (bytes + multiple - 1) / multiple * multiple;
+}
+
+// Wait up to ms milliseconds on sem, ignoring timeouts and signals.
+//
+static void
+waitFor(sem_t *sem, int ms)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += (long)ms * 1000000;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000;
+    deadline.tv_nsec %= 1000000000;
+    sem_timedwait(sem, &deadline);
+}
+
+SharedFrameRing::SharedFrameRing(const std::string &name, cv::Size size, unsigned slots)
+    : itsName(name)
+    , itsOwner(true)
+    , itsMapping()
+    , itsHeader(nullptr)
+{
+    const uint64_t pageBytes = sysconf(_SC_PAGESIZE);
+    const uint64_t headerBytes = roundUp(sizeof(shared_ring_header), pageBytes);
+    const uint64_t slotBytes = roundUp(sizeof(uint64_t) + (uint64_t)size.width * size.height, pageBytes);
+    const uint64_t bytes = headerBytes + slots * slotBytes;
+
+    const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+        throw std::system_error(errno, std::system_category(), "Cannot create " + name);
+    if (ftruncate(fd, bytes) < 0) {
+        const int error = errno;
+        close(fd);
+        shm_unlink(name.c_str());
+        throw std::system_error(error, std::system_category(), "Cannot size " + name);
+    }
+    try {
+        itsMapping.reset(new mmap_buffer(fd, 0, bytes));
+    } catch (...) {
+        close(fd);
+        shm_unlink(name.c_str());
+        throw;
+    }
+    close(fd);
+
+    itsHeader = new (itsMapping->get()) shared_ring_header;
+    memcpy(itsHeader->magic, SHARED_RING_MAGIC, sizeof(itsHeader->magic));
+    itsHeader->width = size.width;
+    itsHeader->height = size.height;
+    itsHeader->slots = slots;
+    itsHeader->slotBytes = slotBytes;
+    itsHeader->headerBytes = headerBytes;
+    itsHeader->written.store(0);
+    itsHeader->read.store(0);
+    itsHeader->ended.store(0);
+    sem_init(&itsHeader->frames, 1, 0);
+    sem_init(&itsHeader->space, 1, 0);
+}
+
+SharedFrameRing::SharedFrameRing(const std::string &name)
+    : itsName(name)
+    , itsOwner(false)
+    , itsMapping()
+    , itsHeader(nullptr)
+{
+    const int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0)
+        throw std::system_error(errno, std::system_category(), "Cannot open " + name);
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(shared_ring_header)) {
+        close(fd);
+        throw std::runtime_error("Truncated frame ring " + name);
+    }
+    try {
+        itsMapping.reset(new mmap_buffer(fd, 0, st.st_size));
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+
+    itsHeader = static_cast<shared_ring_header *>(itsMapping->get());
+    if (memcmp(itsHeader->magic, SHARED_RING_MAGIC, sizeof(itsHeader->magic)) != 0
+        || itsHeader->headerBytes + itsHeader->slots * itsHeader->slotBytes > (uint64_t)st.st_size)
+        throw std::runtime_error("Corrupt frame ring " + name);
+}
+
+SharedFrameRing::~SharedFrameRing() {
+    if (itsOwner) {
+        sem_destroy(&itsHeader->frames);
+        sem_destroy(&itsHeader->space);
+        itsMapping.reset();
+        shm_unlink(itsName.c_str());
+    }
+}
+
+char *
+SharedFrameRing::slot(uint64_t frame) const
+{
+    return static_cast<char *>(itsMapping->get()) + itsHeader->headerBytes
+        + frame % itsHeader->slots * itsHeader->slotBytes;
+}
+
+bool
+SharedFrameRing::push(const cv::Mat &frame, uint64_t timestamp)
+{
+    if (frame.cols != (int)itsHeader->width || frame.rows != (int)itsHeader->height)
+        throw std::runtime_error("Frame size changed in " + itsName);
+
+    const uint64_t written = itsHeader->written.load(std::memory_order_relaxed);
+    if (written - itsHeader->read.load(std::memory_order_acquire) >= itsHeader->slots)
+        return false;
+
+    char *into = slot(written);
+    memcpy(into, &timestamp, sizeof(timestamp));
+    cv::Mat luma(frame.rows, frame.cols, CV_8UC1, into + sizeof(uint64_t));
+    frame.copyTo(luma);
+    itsHeader->written.store(written + 1, std::memory_order_release);
+    sem_post(&itsHeader->frames);
+    return true;
+}
+
+void
+SharedFrameRing::waitForSpace(int ms)
+{
+    waitFor(&itsHeader->space, ms);
+}
+
+void
+SharedFrameRing::finish()
+{
+    itsHeader->ended.store(1, std::memory_order_release);
+    sem_post(&itsHeader->frames);
+}
+
+bool
+SharedFrameRing::next(cv::Mat &into, uint64_t &timestamp)
+{
+    for (;;) {
+        // Look at ended first: the frames published before it was set
+        // are then visible below.
+        const bool ended = itsHeader->ended.load(std::memory_order_acquire);
+        const uint64_t read = itsHeader->read.load(std::memory_order_relaxed);
+        if (read < itsHeader->written.load(std::memory_order_acquire)) {
+            char *from = slot(read);
+            memcpy(&timestamp, from, sizeof(timestamp));
+            into = cv::Mat(itsHeader->height, itsHeader->width, CV_8UC1, from + sizeof(uint64_t));
+            return true;
+        }
+        if (ended)
+            return false;
+        waitFor(&itsHeader->frames, RING_POLL_MS);
+    }
+}
+
+void
+SharedFrameRing::release()
+{
+    itsHeader->read.fetch_add(1, std::memory_order_release);
+    sem_post(&itsHeader->space);
+}
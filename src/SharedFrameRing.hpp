@@ -0,0 +1,96 @@
+#ifndef SHARED_FRAME_RING_H_INCLUDED
+#define SHARED_FRAME_RING_H_INCLUDED
+
+#include <semaphore.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include <opencv2/core/core.hpp>
+
+#define SHARED_RING_MAGIC "CRIBSHM1"
+
+class mmap_buffer;
+
+// The start of the shared memory object, followed by the slots at
+// headerBytes. A slot is a uint64_t time stamp in microseconds followed
+// by a width x height luma plane.
+//
+// The counters are the truth: a slot holds a frame when it is between
+// read and written. The semaphores only wake whoever waits for a frame
+// or for room, so stale posts left behind by a crashed worker are
+// harmless, and a restarted worker resumes at the frame its predecessor
+// did not finish.
+//
+struct shared_ring_header {
+    char magic[8];
+    uint32_t width, height;
+    uint64_t slots;
+    uint64_t slotBytes;
+    uint64_t headerBytes;
+    std::atomic<uint64_t> written;     // frames published by the supervisor
+    std::atomic<uint64_t> read;        // frames released by the worker
+    std::atomic<uint32_t> ended;       // nothing follows written
+    sem_t frames;                      // posted per frame published
+    sem_t space;                       // posted per frame released
+};
+
+// A single-producer single-consumer ring of frames in POSIX shared
+// memory, between the supervisor, which captures, and a worker process,
+// which analyzes in place.
+//
+class SharedFrameRing {
+    std::string itsName;
+    bool itsOwner;
+    std::unique_ptr<mmap_buffer> itsMapping;
+    shared_ring_header *itsHeader;
+
+    char *slot(uint64_t frame) const;
+
+public:
+
+    // Create the shared memory object name for slots frames of size.
+    //
+    SharedFrameRing(const std::string &name, cv::Size size, unsigned slots);
+
+    // Open the shared memory object name created by the supervisor.
+    //
+    explicit SharedFrameRing(const std::string &name);
+
+    // Unmap, and remove the object if this created it.
+    //
+    ~SharedFrameRing();
+
+    SharedFrameRing(const SharedFrameRing&) = delete;
+    SharedFrameRing &operator=(const SharedFrameRing&) = delete;
+
+    const std::string &name() const { return itsName; }
+    cv::Size frameSize() const { return cv::Size(itsHeader->width, itsHeader->height); }
+
+    // Copy frame into the next free slot and publish it. Return false
+    // without waiting if the worker has not released a slot.
+    //
+    bool push(const cv::Mat &frame, uint64_t timestamp);
+
+    // Wait up to ms milliseconds for the worker to release a slot.
+    //
+    void waitForSpace(int ms);
+
+    // Tell the worker that no more frames follow.
+    //
+    void finish();
+
+    // Point into at the oldest unreleased frame, waiting for one, and set
+    // timestamp to its time. Return false once the ring is finished and
+    // drained.
+    //
+    bool next(cv::Mat &into, uint64_t &timestamp);
+
+    // Hand the slot of the frame from next() back to the supervisor.
+    //
+    void release();
+};
+
+#endif // #ifndef SHARED_FRAME_RING_H_INCLUDED
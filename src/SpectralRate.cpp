@@ -0,0 +1,66 @@
+#include <math.h>
+
+#include <algorithm>
+
+#include "SpectralRate.hpp"
+
+// Bins a quarter of the resolution of the window apart, so the peak is
+// found between them by interpolation.
+//
+SpectralRate::SpectralRate(double low, double high, double window)
+    : itsLow(low), itsStep(1.0 / (4 * window)), itsWindow(window), itsSum(), itsPower()
+    , itsStarted(false), itsStart(0.0), itsLast(0.0), itsMean(0.0)
+    , itsRate(0.0), itsConfidence(0.0)
+{
+    const int bins = std::max(3, 1 + (int)((high - low) / itsStep));
+    itsSum.assign(bins, 0.0);
+    itsPower.assign(bins, 0.0);
+}
+
+void
+SpectralRate::add(double seconds, double sample)
+{
+    if (!itsStarted) {
+        itsStarted = true;
+        itsStart = itsLast = seconds;
+        itsMean = sample;
+    }
+    const double decay = exp(-(seconds - itsLast) / itsWindow);
+    itsLast = seconds;
+    itsMean = decay * itsMean + (1 - decay) * sample;
+    const double x = sample - itsMean;
+
+    // Each bin is the sum of x e^(-2 pi i f t) weighted by e^(-age / window).
+    const double t = seconds - itsStart;
+    const int bins = itsSum.size();
+    double total = 0.0;
+    int peak = 0;
+    for (int k = 0; k < bins; k++) {
+        const double f = itsLow + k * itsStep;
+        itsSum[k] = decay * itsSum[k] + x * std::polar(1.0, -2 * M_PI * f * t);
+        itsPower[k] = std::norm(itsSum[k]);
+        total += itsPower[k];
+        if (itsPower[k] > itsPower[peak]) {
+            peak = k;
+        }
+    }
+    if (total <= 0.0) {
+        itsConfidence = 0.0;
+        return;
+    }
+
+    // Fit a parabola through the peak and its neighbours.
+    double offset = 0.0, around = itsPower[peak];
+    if (peak > 0 && peak < bins - 1) {
+        const double a = itsPower[peak - 1], b = itsPower[peak], c = itsPower[peak + 1];
+        const double curve = a - 2 * b + c;
+        if (curve < 0) {
+            offset = 0.5 * (a - c) / curve;
+        }
+        around += a + c;
+    } else {
+        around += itsPower[peak > 0 ? peak - 1 : peak + 1];
+    }
+    itsRate = itsLow + (peak + offset) * itsStep;
+    itsConfidence = around / total;
+}
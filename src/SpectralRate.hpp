@@ -0,0 +1,44 @@
+#ifndef SPECTRAL_RATE_H_INCLUDED
+#define SPECTRAL_RATE_H_INCLUDED
+
+#include <complex>
+#include <vector>
+
+// Estimate the dominant frequency of a signal within a band, one sample
+// at a time, from a bank of DFT bins over an exponentially decaying
+// window. Each sample costs one complex multiply-add per bin, whatever
+// the window, and samples may come at any times, so dropped frames and
+// slow frame rates only cost resolution, not correctness.
+//
+class SpectralRate {
+    double itsLow, itsStep;            // Hz of the first bin, between bins
+    double itsWindow;                  // seconds, the decay time constant
+    std::vector<std::complex<double>> itsSum; // the DFT of each bin
+    std::vector<double> itsPower;
+    bool itsStarted;
+    double itsStart, itsLast;          // seconds of the first, last sample
+    double itsMean;                    // of the samples, decaying likewise
+    double itsRate, itsConfidence;
+
+public:
+
+    // Look for frequencies from low to high Hz over about window seconds.
+    //
+    SpectralRate(double low, double high, double window);
+
+    // Add the sample taken at seconds, which must not go backwards.
+    //
+    void add(double seconds, double sample);
+
+    // Return the frequency with the most power in the band, in Hz,
+    // interpolated between bins, or 0 before the first sample.
+    //
+    double rate() const { return itsRate; }
+
+    // Return the part of the power in the band that is around rate(),
+    // about a third for white noise, approaching 1 for a pure tone.
+    //
+    double confidence() const { return itsConfidence; }
+};
+
+#endif // #ifndef SPECTRAL_RATE_H_INCLUDED
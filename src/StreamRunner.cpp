@@ -0,0 +1,249 @@
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CommandLine.hpp"
+#include "FrameRecorder.hpp"
+#include "MotionDetection.hpp"
+#include "StreamRunner.hpp"
+#include "VideoSource.hpp"
+#include "WorkerPool.hpp"
+
+static uint64_t
+now_us()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// One camera or file, its detector, and the mailbox between its reader
+// thread and the pool. Everything below the mailbox comment is guarded
+// by Runner::mutex.
+//
+struct Stream {
+    const CommandLine cl;
+    const std::string name;
+    std::unique_ptr<VideoSource> source;
+    std::unique_ptr<FrameRecorder> recorder;
+    std::unique_ptr<MotionDetection> detector;
+    std::thread reader;
+    bool live;                         // drop stale frames rather than wait
+    uint64_t period;                   // microseconds per frame of input_fps
+
+    // The analyzed frame, touched only by the job that has the stream busy.
+    cv::Mat work;
+    uint64_t workTimestamp;
+    uint64_t workDeadline;
+
+    // mailbox
+    cv::Mat latest;
+    uint64_t latestTimestamp;
+    uint64_t deadline;                 // when latest should have been analyzed
+    bool fresh;                        // latest is not analyzed yet
+    bool busy;                         // a job for this is on the pool
+    bool ended;                        // the reader is done
+    std::string error;
+    uint64_t analyzed, dropped, late;
+
+    Stream(const CommandLine &config, const std::string &label)
+        : cl(config), name(label), source(), recorder(), detector(), reader()
+        , live(false), period(0), work(), workTimestamp(0), workDeadline(0)
+        , latest(), latestTimestamp(0), deadline(0), fresh(false), busy(false)
+        , ended(false), error(), analyzed(0), dropped(0), late(0)
+    {}
+
+    bool failed() const { return !error.empty(); }
+};
+
+struct Runner {
+    std::mutex mutex;
+    std::condition_variable cv;
+    unsigned inFlight;
+    std::vector<std::unique_ptr<Stream>> streams;
+
+    Runner() : mutex(), cv(), inFlight(0), streams() {}
+};
+
+// Runs on the reader thread of stream: move each frame into the mailbox.
+// A live stream replaces a frame the pool did not get to, keeping the
+// older deadline. A file waits for room instead, so no frame is lost.
+//
+static void
+readFrames(Runner *runner, Stream *stream)
+{
+    std::string error;
+    try {
+        for (;;) {
+            cv::Mat frame; uint64_t timestamp = 0;
+            const bool more = stream->source->read(frame, timestamp);
+            if (!frame.empty()) {
+                if (stream->recorder)
+                    stream->recorder->record(frame, timestamp);
+                // The detector may hold on to its input, and a camera
+                // frame is only valid until the next read.
+                cv::Mat copy = frame.clone();
+                std::unique_lock<std::mutex> lock(runner->mutex);
+                while (!stream->live && stream->fresh && !stream->failed())
+                    runner->cv.wait(lock);
+                if (stream->failed())
+                    break;
+                if (stream->fresh) {
+                    stream->dropped++;
+                } else {
+                    stream->deadline = now_us() + stream->period;
+                }
+                stream->latest = copy;
+                stream->latestTimestamp = timestamp;
+                stream->fresh = true;
+                lock.unlock();
+                runner->cv.notify_all();
+            }
+            if (!more)
+                break;
+        }
+    } catch (const std::exception &e) {
+        error = e.what();
+    }
+    {
+        std::lock_guard<std::mutex> lock(runner->mutex);
+        if (!error.empty())
+            stream->error = error;
+        stream->ended = true;
+    }
+    runner->cv.notify_all();
+}
+
+// Runs on the pool: analyze the frame taken from the mailbox of stream.
+//
+static void
+analyzeFrame(Runner *runner, Stream *stream)
+{
+    std::string error;
+    try {
+        stream->detector->update(stream->work, stream->workTimestamp);
+    } catch (const std::exception &e) {
+        error = e.what();
+    }
+    const uint64_t done = now_us();
+    {
+        std::lock_guard<std::mutex> lock(runner->mutex);
+        if (!error.empty())
+            stream->error = error;
+        stream->analyzed++;
+        if (done > stream->workDeadline)
+            stream->late++;
+        stream->busy = false;
+        runner->inFlight--;
+    }
+    runner->cv.notify_all();
+}
+
+// Open the source, recorder and detector of a stream configured by cl.
+//
+static std::unique_ptr<Stream>
+openStream(const CommandLine &cl)
+{
+    std::string name = cl.configPath;
+    const std::string::size_type n = name.rfind("/");
+    if (n != std::string::npos)
+        name = name.substr(n + 1);
+
+    std::unique_ptr<Stream> stream(new Stream(cl, name));
+    stream->source.reset(new VideoSource(cl.cameraId, cl.inFile, cl.input_fps,
+                                         cl.frameWidth, cl.frameHeight, cl.inFormat));
+    if (!cl.recordPath.empty())
+        stream->recorder.reset(new FrameRecorder(cl.recordPath, cl.recordHours, cl.input_fps));
+    stream->detector.reset(new MotionDetection(stream->cl, STREAM_DETECTOR, name));
+    stream->live = stream->source->isCamera();
+    stream->period = 1e6 / cl.input_fps;
+    return stream;
+}
+
+bool loadStreams(const CommandLine &cl, std::vector<CommandLine> &configs)
+{
+    if (cl.sourceCount)
+        configs.push_back(cl);
+    for (const std::string &path : cl.streams) {
+        CommandLine config(cl);
+        if (!config.load(path))
+            return false;
+        if (!config.sourceCount) {
+            fprintf(stderr, "[error] %s: Specify an input or a camera.\n", path.c_str());
+            return false;
+        }
+        configs.push_back(config);
+    }
+    return true;
+}
+
+int runStreams(const CommandLine &cl)
+{
+    std::vector<CommandLine> configs;
+    if (!loadStreams(cl, configs))
+        return 1;
+    Runner runner;
+    for (const CommandLine &config : configs)
+        runner.streams.push_back(openStream(config));
+
+    WorkerPool pool(cl.jobs);
+    printf("[info] Monitoring %zu streams on %u threads.\n", runner.streams.size(), pool.size());
+    for (auto &stream : runner.streams)
+        stream->reader = std::thread(readFrames, &runner, stream.get());
+
+    // Earliest deadline first, and never more jobs than the pool has
+    // threads: the queue of the pool would serve them in FIFO order.
+    {
+        std::unique_lock<std::mutex> lock(runner.mutex);
+        for (;;) {
+            Stream *next = nullptr;
+            bool running = false;
+            for (auto &stream : runner.streams) {
+                Stream *s = stream.get();
+                if (s->failed()) {
+                    running = running || s->busy;
+                    continue;
+                }
+                running = running || s->busy || s->fresh || !s->ended;
+                if (s->fresh && !s->busy && (!next || s->deadline < next->deadline))
+                    next = s;
+            }
+            if (!running)
+                break;
+            if (next == nullptr || runner.inFlight >= pool.size()) {
+                runner.cv.wait(lock);
+                continue;
+            }
+            next->busy = true;
+            next->fresh = false;
+            next->work = next->latest;
+            next->latest.release();
+            next->workTimestamp = next->latestTimestamp;
+            next->workDeadline = next->deadline;
+            runner.inFlight++;
+            lock.unlock();
+            runner.cv.notify_all();     // a file reader may wait for room
+            pool.push(analyzeFrame, &runner, next);
+            lock.lock();
+        }
+    }
+
+    int status = 0;
+    for (auto &stream : runner.streams) {
+        stream->reader.join();
+        printf("[info] %s: %" PRIu64 " frames analyzed, %" PRIu64 " dropped, %" PRIu64 " late\n",
+               stream->name.c_str(), stream->analyzed, stream->dropped, stream->late);
+        if (stream->failed()) {
+            fprintf(stderr, "[error] %s: %s\n", stream->name.c_str(), stream->error.c_str());
+            status = 1;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,25 @@
+#ifndef STREAM_RUNNER_H_INCLUDED
+#define STREAM_RUNNER_H_INCLUDED
+
+#include <vector>
+
+struct CommandLine;
+
+// Append to configs the settings of every stream: cl itself if it has an
+// input, then each INI file in cl.streams. Return false if one of those
+// does not load or has no input.
+//
+bool loadStreams(const CommandLine &cl, std::vector<CommandLine> &configs);
+
+// Monitor every stream at once in this process: the input of cl, if it
+// has one, and the input of each INI file in cl.streams. Each stream is
+// read on a thread of its own into a mailbox holding its latest frame,
+// and the frames are analyzed on one pool of cl.jobs threads, earliest
+// deadline first. A stream's deadline is one frame period of its own
+// input_fps after its frame arrived, so a busy pool drops the stale
+// frames of live cameras evenly across streams rather than starving any.
+// Return 0 once every stream ended cleanly or 1 otherwise.
+//
+int runStreams(const CommandLine &cl);
+
+#endif // #ifndef STREAM_RUNNER_H_INCLUDED
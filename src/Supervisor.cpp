@@ -0,0 +1,353 @@
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "CommandLine.hpp"
+#include "FrameRecorder.hpp"
+#include "MotionDetection.hpp"
+#include "SharedFrameRing.hpp"
+#include "StreamRunner.hpp"
+#include "Supervisor.hpp"
+#include "VideoSource.hpp"
+
+// Frames in flight between the supervisor and each worker.
+#define WORKER_RING_SLOTS 8
+
+// How often the supervisor looks for dead workers, and how long it waits
+// before restarting one, so a worker that cannot start does not spin.
+#define SUPERVISOR_POLL_MS 100
+#define RESTART_DELAY_MS 1000
+
+static volatile sig_atomic_t stopping = 0;
+
+static void
+onSignal(int)
+{
+    stopping = 1;
+}
+
+static uint64_t
+now_ms()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static std::string
+baseName(const std::string &path)
+{
+    const std::string::size_type n = path.rfind("/");
+    return n == std::string::npos ? path : path.substr(n + 1);
+}
+
+// One stream: captured here into ring, analyzed by the process pid.
+//
+struct Worker {
+    const CommandLine cl;
+    const std::string name;
+    cpu_set_t cpus;
+    std::unique_ptr<VideoSource> source;
+    std::unique_ptr<FrameRecorder> recorder;
+    std::unique_ptr<SharedFrameRing> ring;
+    std::thread reader;
+    bool live;                         // drop frames rather than wait
+    std::atomic<uint64_t> dropped;
+
+    pid_t pid;                         // 0 while not running
+    uint64_t restartAt;                // when to start it again
+    unsigned restarts;
+    bool finished;                     // exited after draining the ring
+
+    Worker(const CommandLine &config, const cpu_set_t &set)
+        : cl(config), name(baseName(config.configPath)), cpus(set), source()
+        , recorder(), ring(), reader(), live(false), dropped(0), pid(0)
+        , restartAt(0), restarts(0), finished(false)
+    {}
+};
+
+// Return the CPUs in a sysfs list such as "0-3,8-11".
+//
+static std::vector<int>
+parseCpuList(const std::string &list)
+{
+    std::vector<int> result;
+    const char *p = list.c_str();
+    while (*p) {
+        char *end;
+        const long first = strtol(p, &end, 10);
+        if (end == p)
+            break;
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+            result.push_back(cpu);
+        if (*p == ',')
+            p++;
+    }
+    return result;
+}
+
+// Return the CPUs of each NUMA node, or nothing without sysfs.
+//
+static std::vector<std::vector<int>>
+numaNodes()
+{
+    std::vector<std::vector<int>> result;
+    static const char root[] = "/sys/devices/system/node";
+    DIR *dir = opendir(root);
+    if (dir == nullptr)
+        return result;
+    while (struct dirent *entry = readdir(dir)) {
+        int node;
+        char tail;
+        if (sscanf(entry->d_name, "node%d%c", &node, &tail) != 1)
+            continue;
+        std::ifstream in(std::string(root) + "/" + entry->d_name + "/cpulist");
+        std::string list;
+        if (std::getline(in, list))
+            result.push_back(parseCpuList(list));
+    }
+    closedir(dir);
+    return result;
+}
+
+// Return the CPUs of each of count workers: the NUMA nodes we may run on
+// in turn, or with only one node, equal groups of the cores we may run
+// on, so workers share a cache and memory controller with no one else.
+//
+static std::vector<cpu_set_t>
+cpuGroups(size_t count)
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+        throw std::system_error(errno, std::system_category(), "sched_getaffinity");
+
+    std::vector<std::vector<int>> groups;
+    for (const std::vector<int> &node : numaNodes()) {
+        std::vector<int> cpus;
+        for (int cpu : node)
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+                cpus.push_back(cpu);
+        if (!cpus.empty())
+            groups.push_back(cpus);
+    }
+    if (groups.size() < 2) {
+        std::vector<int> cpus;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            if (CPU_ISSET(cpu, &allowed))
+                cpus.push_back(cpu);
+        const size_t n = std::min(count, cpus.size());
+        groups.clear();
+        for (size_t g = 0; g < n; g++)
+            groups.push_back(std::vector<int>(cpus.begin() + g * cpus.size() / n,
+                                              cpus.begin() + (g + 1) * cpus.size() / n));
+    }
+
+    std::vector<cpu_set_t> result(count);
+    for (size_t i = 0; i < count; i++) {
+        CPU_ZERO(&result[i]);
+        for (int cpu : groups[i % groups.size()])
+            CPU_SET(cpu, &result[i]);
+    }
+    return result;
+}
+
+// Runs on the reader thread of worker, on the CPUs of the worker, so the
+// pages of its ring are allocated near it.
+//
+static void
+readFrames(Worker *worker)
+{
+    sched_setaffinity(0, sizeof(worker->cpus), &worker->cpus);
+    try {
+        while (!stopping) {
+            cv::Mat frame; uint64_t timestamp = 0;
+            const bool more = worker->source->read(frame, timestamp);
+            if (!frame.empty()) {
+                if (worker->recorder)
+                    worker->recorder->record(frame, timestamp);
+                while (!worker->ring->push(frame, timestamp)) {
+                    if (worker->live) {
+                        worker->dropped++;
+                        break;
+                    }
+                    if (stopping)
+                        break;
+                    worker->ring->waitForSpace(SUPERVISOR_POLL_MS);
+                }
+            }
+            if (!more)
+                break;
+        }
+    } catch (const std::exception &e) {
+        fprintf(stderr, "[error] %s: %s\n", worker->name.c_str(), e.what());
+    }
+    worker->ring->finish();
+}
+
+// Start the worker process for worker, running av0 --config ... --worker ...
+//
+static void
+spawn(Worker *worker, const std::string &av0)
+{
+    const std::string configOption = "--config", workerOption = "--worker";
+    std::vector<char *> argv = {
+        const_cast<char *>(av0.c_str()),
+        const_cast<char *>(configOption.c_str()),
+        const_cast<char *>(worker->cl.configPath.c_str()),
+        const_cast<char *>(workerOption.c_str()),
+        const_cast<char *>(worker->ring->name().c_str()),
+        nullptr
+    };
+    const pid_t parent = getpid();
+    const pid_t pid = fork();
+    if (pid < 0) {
+        perror("[error] fork");
+        worker->restartAt = now_ms() + RESTART_DELAY_MS;
+        return;
+    }
+    if (pid == 0) {
+        // Only async-signal-safe calls between fork() and exec().
+        sched_setaffinity(0, sizeof(worker->cpus), &worker->cpus);
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        if (getppid() != parent)
+            _exit(1);
+        execv("/proc/self/exe", argv.data());
+        _exit(127);
+    }
+    worker->pid = pid;
+}
+
+int supervise(const CommandLine &cl)
+{
+    std::vector<CommandLine> configs;
+    if (!loadStreams(cl, configs))
+        return 1;
+
+    const std::vector<cpu_set_t> cpus = cpuGroups(configs.size());
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (size_t i = 0; i < configs.size(); i++) {
+        const CommandLine &config = configs[i];
+        std::unique_ptr<Worker> worker(new Worker(config, cpus[i]));
+        worker->source.reset(new VideoSource(config.cameraId, config.inFile, config.input_fps,
+                                             config.frameWidth, config.frameHeight, config.inFormat));
+        if (!config.recordPath.empty())
+            worker->recorder.reset(new FrameRecorder(config.recordPath, config.recordHours, config.input_fps));
+        const std::string ring = "/cribsense-" + std::to_string(getpid()) + "-" + std::to_string(i);
+        worker->ring.reset(new SharedFrameRing(ring, worker->source->frameSize(), WORKER_RING_SLOTS));
+        worker->live = worker->source->isCamera();
+        workers.push_back(std::move(worker));
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onSignal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    printf("[info] Supervising %zu workers.\n", workers.size());
+    for (auto &worker : workers) {
+        spawn(worker.get(), cl.av0);
+        worker->reader = std::thread(readFrames, worker.get());
+    }
+
+    int status = 0;
+    while (!stopping) {
+        int how;
+        pid_t pid;
+        while ((pid = waitpid(-1, &how, WNOHANG)) > 0) {
+            for (auto &worker : workers) {
+                if (worker->pid != pid)
+                    continue;
+                worker->pid = 0;
+                if (WIFEXITED(how) && WEXITSTATUS(how) == 0) {
+                    worker->finished = true;
+                } else {
+                    if (WIFSIGNALED(how)) {
+                        fprintf(stderr, "[error] %s: worker %d killed by signal %d, restarting.\n",
+                                worker->name.c_str(), pid, WTERMSIG(how));
+                    } else {
+                        fprintf(stderr, "[error] %s: worker %d exited with %d, restarting.\n",
+                                worker->name.c_str(), pid, WEXITSTATUS(how));
+                    }
+                    worker->restartAt = now_ms() + RESTART_DELAY_MS;
+                }
+            }
+        }
+
+        bool running = false;
+        for (auto &worker : workers) {
+            if (worker->finished)
+                continue;
+            running = true;
+            if (worker->pid == 0 && now_ms() >= worker->restartAt) {
+                spawn(worker.get(), cl.av0);
+                worker->restarts++;
+            }
+        }
+        if (!running)
+            break;
+        usleep(SUPERVISOR_POLL_MS * 1000);
+    }
+
+    if (stopping) {
+        for (auto &worker : workers)
+            if (worker->pid)
+                kill(worker->pid, SIGTERM);
+        for (auto &worker : workers)
+            if (worker->pid)
+                waitpid(worker->pid, nullptr, 0);
+    }
+    for (auto &worker : workers) {
+        worker->reader.join();
+        printf("[info] %s: %" PRIu64 " frames dropped, %u restarts\n",
+               worker->name.c_str(), worker->dropped.load(), worker->restarts);
+        if (!worker->finished && !stopping)
+            status = 1;
+    }
+    return status;
+}
+
+int runWorker(const CommandLine &cl)
+{
+    SharedFrameRing ring(cl.workerRing);
+
+    // The supervisor knows the real frame size, and no one is watching.
+    CommandLine config(cl);
+    config.frameWidth = ring.frameSize().width;
+    config.frameHeight = ring.frameSize().height;
+    config.showDiff = false;
+    config.showMagnification = false;
+    MotionDetection detector(config, LIVE_DETECTOR, baseName(cl.configPath));
+
+    cv::Mat frame; uint64_t timestamp = 0;
+    while (ring.next(frame, timestamp)) {
+        detector.update(frame, timestamp);
+        ring.release();
+    }
+    return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef SUPERVISOR_H_INCLUDED
+#define SUPERVISOR_H_INCLUDED
+
+struct CommandLine;
+
+// Capture every stream of cl (as for runStreams()) in this process, and
+// analyze each in a worker process of its own that reads the frames in
+// place from a POSIX shared memory ring. Workers are pinned round-robin
+// to the NUMA nodes of the machine, or to equal groups of cores if it
+// has only one, and a worker that dies is restarted without disturbing
+// the others. Return 0 once every worker finished its stream.
+//
+int supervise(const CommandLine &cl);
+
+// Run as the worker analyzing the shared memory ring cl.workerRing with
+// the settings of cl, until the supervisor finishes the ring.
+//
+int runWorker(const CommandLine &cl);
+
+#endif // #ifndef SUPERVISOR_H_INCLUDED
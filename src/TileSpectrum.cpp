@@ -0,0 +1,99 @@
+#include <math.h>
+
+#include <algorithm>
+
+#include "TileSpectrum.hpp"
+
+// A roi window lasts some 10 seconds, which resolves about 0.1 Hz.
+#define TILE_BIN_STEP 0.1
+
+TileSpectrum::TileSpectrum(cv::Size frame, int size, double low, double high)
+    : itsSize(size), itsRows((frame.height + size - 1) / size)
+    , itsCols((frame.width + size - 1) / size), itsFrame(frame)
+    , itsFrequencies(), itsSum(), itsBasis(), itsTotal(), itsCounts()
+    , itsPhasors(), itsSamples(0), itsStart(0.0)
+{
+    const int bins = std::max(2, 1 + (int)lround((high - low) / TILE_BIN_STEP));
+    for (int k = 0; k < bins; k++) {
+        itsFrequencies.push_back(low + k * (high - low) / (bins - 1));
+    }
+    itsPhasors.resize(bins);
+    itsCounts.resize(itsRows * itsCols);
+    clear();
+}
+
+void
+TileSpectrum::clear()
+{
+    const size_t bins = itsFrequencies.size();
+    itsSum.assign(itsRows * itsCols * bins, 0.0);
+    itsBasis.assign(bins, 0.0);
+    itsTotal.assign(itsRows * itsCols, 0.0);
+    itsSamples = 0;
+}
+
+void
+TileSpectrum::add(double seconds, const BitMask &mask)
+{
+    if (itsSamples++ == 0) {
+        itsStart = seconds;
+    }
+    const double t = seconds - itsStart;
+    const int bins = itsFrequencies.size();
+    for (int k = 0; k < bins; k++) {
+        itsPhasors[k] = std::polar(1.0, -2 * M_PI * itsFrequencies[k] * t);
+        itsBasis[k] += itsPhasors[k];
+    }
+
+    std::fill(itsCounts.begin(), itsCounts.end(), 0);
+    const int rows = std::min(mask.rows(), itsFrame.height);
+    const int cols = std::min(mask.cols(), itsFrame.width);
+    for (int y = 0; y < rows; y++) {
+        unsigned *counts = itsCounts.data() + (y / itsSize) * itsCols;
+        for (int x = 0; x < itsCols; x++) {
+            const int begin = x * itsSize;
+            counts[x] += mask.count(y, begin, std::min(begin + itsSize, cols));
+        }
+    }
+
+    // Most tiles see no change in most frames, and cost nothing more.
+    for (int i = 0; i < itsRows * itsCols; i++) {
+        const unsigned count = itsCounts[i];
+        if (count == 0) {
+            continue;
+        }
+        itsTotal[i] += count;
+        std::complex<double> *sum = itsSum.data() + (size_t)i * bins;
+        for (int k = 0; k < bins; k++) {
+            sum[k] += (double)count * itsPhasors[k];
+        }
+    }
+}
+
+cv::Rect
+TileSpectrum::tile(int y, int x) const
+{
+    return cv::Rect(x * itsSize, y * itsSize, itsSize, itsSize)
+        & cv::Rect(0, 0, itsFrame.width, itsFrame.height);
+}
+
+// Taking the mean count m of a tile out of each sample takes m times the
+// sum of the phasors out of each bin.
+//
+std::vector<double>
+TileSpectrum::energy() const
+{
+    std::vector<double> result(itsRows * itsCols, 0.0);
+    if (itsSamples == 0) {
+        return result;
+    }
+    const int bins = itsFrequencies.size();
+    for (int i = 0; i < itsRows * itsCols; i++) {
+        const double mean = itsTotal[i] / itsSamples;
+        const std::complex<double> *sum = itsSum.data() + (size_t)i * bins;
+        for (int k = 0; k < bins; k++) {
+            result[i] += std::norm(sum[k] - mean * itsBasis[k]);
+        }
+    }
+    return result;
+}
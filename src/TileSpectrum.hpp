@@ -0,0 +1,60 @@
+#ifndef TILE_SPECTRUM_H_INCLUDED
+#define TILE_SPECTRUM_H_INCLUDED
+
+#include <complex>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "BitMask.hpp"
+
+// Tell where in a frame the motion is at the breathing rate. The frame is
+// cut into square tiles, and each mask of changed pixels added adds the
+// number of them in each tile to a few DFT bins spanning the band. A
+// frame costs a count of its words and one complex multiply-add per bin
+// of each tile that changed, so it replaces dilating and labelling the
+// accumulated mask, and favours what moves at the rate of breathing over
+// what merely moves a lot.
+//
+class TileSpectrum {
+    int itsSize;                       // of a tile, in pixels
+    int itsRows, itsCols;              // tiles down and across
+    cv::Size itsFrame;
+    std::vector<double> itsFrequencies;        // Hz of each bin
+    std::vector<std::complex<double>> itsSum;  // bins of each tile in turn
+    std::vector<std::complex<double>> itsBasis; // sum of the phasors of each bin
+    std::vector<double> itsTotal;      // changed pixels of each tile
+    std::vector<unsigned> itsCounts;   // of the last mask added
+    std::vector<std::complex<double>> itsPhasors; // of the last mask added
+    unsigned itsSamples;
+    double itsStart;
+
+public:
+
+    // Cut a frame of frame pixels into tiles of size x size, looking for
+    // frequencies from low to high Hz.
+    //
+    TileSpectrum(cv::Size frame, int size, double low, double high);
+
+    // Forget every mask added.
+    //
+    void clear();
+
+    // Add the mask of changed pixels of the frame taken at seconds.
+    //
+    void add(double seconds, const BitMask &mask);
+
+    int rows() const { return itsRows; }
+    int cols() const { return itsCols; }
+
+    // Return the pixels of the tile at row y and column x of the tiles.
+    //
+    cv::Rect tile(int y, int x) const;
+
+    // Return the power in the band of the changed pixels of each tile,
+    // row by row, less their mean, so steady changes have none.
+    //
+    std::vector<double> energy() const;
+};
+
+#endif // #ifndef TILE_SPECTRUM_H_INCLUDED
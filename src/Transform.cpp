@@ -0,0 +1,17 @@
+/**
+ * This file is released is under the Patented Algorithm with Software released
+ * Agreement. See LICENSE.md for more information, and view the original repo
+ * at https://github.com/tbl3rd/Pyramids
+ */
+
+#include "Transform.hpp"
+
+void copyOverlap(const cv::Mat &from, cv::Mat &into, const cv::Point &offset)
+{
+    const cv::Rect there
+        = cv::Rect(offset, into.size()) & cv::Rect(cv::Point(0, 0), from.size());
+    if (there.area() > 0) {
+        cv::Mat part = into(there - offset);
+        from(there).copyTo(part);
+    }
+}
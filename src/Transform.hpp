@@ -0,0 +1,121 @@
+/**
+ * This file is released is under the Patented Algorithm with Software released
+ * Agreement. See LICENSE.md for more information, and view the original repo
+ * at https://github.com/tbl3rd/Pyramids
+ */
+
+#ifndef TRANSFORM_H_INCLUDED
+#define TRANSFORM_H_INCLUDED
+
+#include <opencv2/opencv.hpp>
+
+class CheckpointReader;
+class CheckpointWriter;
+
+// Tags the state of each kind of transform in a checkpoint.
+//
+enum transform_kind {
+    RIESZ_TRANSFORM = 1,
+    LINEAR_TRANSFORM = 2
+};
+
+// A motion magnification engine: the phase-based RieszTransform, or the
+// cheaper LinearTransform.
+//
+class Transform {
+
+public:
+
+    virtual ~Transform() {}
+
+    // Start over on frames like frame.
+    //
+    virtual void initialize(const cv::Mat &frame) = 0;
+
+    // After initialize(), take the state of from where it overlaps the
+    // frame, whose origin is at offset in the last frame of from, if from
+    // is the same kind of transform, so only the rest starts cold.
+    //
+    virtual void migrate(const Transform &from, const cv::Point &offset) = 0;
+
+    // Return the size of the frames this transforms.
+    //
+    virtual cv::Size size() const = 0;
+
+    // Set the frames per second which is the filter sampling frequency.
+    //
+    virtual void fps(double fps) = 0;
+
+    // Set the low or high cut-off frequency of the bandpass filter.
+    //
+    virtual void lowCutoff(double frequency) = 0;
+    virtual void highCutoff(double frequency) = 0;
+
+    // Add another passband from low to high Hz, before initialize(), and
+    // return its index. Every band is filtered from the same pyramid of
+    // each frame, and measured, but only band 0, the one set above, is
+    // magnified.
+    //
+    virtual int addBand(double low, double high) = 0;
+    virtual int bands() const = 0;
+
+    // Update the coarsest levels of the pyramid only every every frames,
+    // at a lower sampling rate, fewer if the bands need it. Coarse levels
+    // hold low spatial frequencies that move slowly enough to be sampled
+    // less often. Transforms with nothing to gain may ignore it.
+    //
+    virtual void decimate(int levels, int every) {}
+
+    // Say that the next frame comes seconds after the last one, or at
+    // the rate set by fps() if seconds is 0, so that it is filtered for
+    // the time that really passed when frames are late or dropped.
+    //
+    virtual void interval(double seconds) = 0;
+
+    // Start the temporal filters in their steady state for the first
+    // frame after initialize(), instead of at zero, so they need not
+    // settle. LinearTransform always starts them so and ignores it.
+    //
+    virtual void warmStart(bool warm) {}
+
+    // Set the amplification (alpha parameter) to value.
+    //
+    virtual void alpha(int value) = 0;
+
+    // Truncate the maximum change to t.
+    //
+    virtual void threshold(int t) = 0;
+
+    // Return copy of frame with motion magnified.
+    //
+    virtual cv::Mat transform(const cv::Mat &frame) = 0;
+
+    // Filter frame as transform() does, but instead of magnifying it,
+    // only measure how much it moved in the passband.
+    //
+    virtual void measure(const cv::Mat &frame) = 0;
+
+    // Return the sum over the pyramid of the squared change in the
+    // passband of band weighted by the squared local amplitude, as of the
+    // last measure(), and the sum of the weights. Their ratio is the mean
+    // squared phase change in radians.
+    //
+    virtual double phaseEnergy(int band = 0) const = 0;
+    virtual double amplitudeEnergy() const = 0;
+
+    // Write the pyramids and filter state to out, once initialized, or
+    // read them back from in instead of initialize(), after setting up
+    // the same bands. Return false from restore() if in holds another
+    // kind of transform or other bands. The frame size comes from in,
+    // and fps() must be set again after.
+    //
+    virtual void save(CheckpointWriter &out) const = 0;
+    virtual bool restore(CheckpointReader &in) = 0;
+};
+
+// Copy into the part of into that lies within from when the origin of into
+// is at offset in from. Leave the rest of into alone.
+//
+void copyOverlap(const cv::Mat &from, cv::Mat &into, const cv::Point &offset);
+
+#endif // #ifndef TRANSFORM_H_INCLUDED
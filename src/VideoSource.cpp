@@ -14,13 +14,17 @@
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <linux/videodev2.h>
+#include <time.h>
 
 #include <opencv2/opencv.hpp>
 
 #include "VideoSource.hpp"
+#include "RawSource.hpp"
 
 #define NUM_BUFFERS 2
 
+#define USEC_PER_SEC 1000000
+
 static inline int
 check_return(int ret) {
     if (ret < 0)
@@ -28,11 +32,13 @@ check_return(int ret) {
     return ret;
 }
 
-mmap_buffer::mmap_buffer(int fd, off_t offset, size_t byte_size) : address(nullptr), bytes(byte_size)
+mmap_buffer::mmap_buffer(int fd, off_t offset, size_t byte_size, int prot, int flags) : address(nullptr), bytes(byte_size)
 {
-    address = mmap (nullptr, byte_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
-    if (address == nullptr)
+    address = mmap (nullptr, byte_size, prot, flags, fd, offset);
+    if (address == MAP_FAILED) {
+        address = nullptr;
         throw std::system_error(errno, std::system_category());
+    }
 }
 
 mmap_buffer::~mmap_buffer() {
@@ -49,7 +55,9 @@ mmap_buffer::mmap_buffer(mmap_buffer&& from) : address(from.address), bytes(from
 cv::Size
 VideoSource::frameSize() const
 {
-    if (isFile()) {
+    if (isRaw()) {
+        return itsRawSource->frameSize();
+    } else if (isFile()) {
         cv::VideoCapture &capture = const_cast<cv::VideoCapture &>(itsFileCapture);
         const int w = capture.get(CV_CAP_PROP_FRAME_WIDTH);
         const int h = capture.get(CV_CAP_PROP_FRAME_HEIGHT);
@@ -176,14 +184,20 @@ VideoSource::startStreaming() {
     check_return(ioctl (itsCameraFd, VIDIOC_STREAMON, &type));
 }
 
-VideoSource::VideoSource(int id, const std::string &fileName_value, int fps_value, int width, int height)
-    : itsFileCapture()
+VideoSource::VideoSource(int id, const std::string &fileName_value, int fps_value, int width, int height,
+                         const std::string &format)
+    : itsFileName(fileName_value)
+    , itsFileCapture()
+    , itsRawSource()
     , itsCameraFd(id >= 0 ? openCamera(id) : -1)
     , itsWidth(width)
     , itsHeight(height)
     , itsStride(2 * width)
     , itsNextBuffer(0)
     , itsCurrentBuffer(-1)
+    , itsFps(fps_value)
+    , itsFrameCount(0)
+    , itsTimestamp(0)
 {
     if (id >= 0) {
         checkCapabilities(itsCameraFd);
@@ -191,6 +205,10 @@ VideoSource::VideoSource(int id, const std::string &fileName_value, int fps_valu
         negotiateFormat();
         setCameraFps(itsCameraFd, fps_value);
         startStreaming();
+    } else if (RawSource::handles(fileName_value, format)) {
+        itsRawSource.reset(new RawSource(fileName_value, format, width, height));
+        if (itsRawSource->fps() > 0)
+            itsFps = itsRawSource->fps();
     } else {
         itsFileCapture.open(fileName_value);
         if (!itsFileCapture.isOpened())
@@ -203,12 +221,45 @@ VideoSource::~VideoSource() {
         close(itsCameraFd);
 }
 
+// Return the timestamp of the next frame: media if it is usable, or else
+// one frame period after the previous frame.
+//
+uint64_t
+VideoSource::nextTimestamp(uint64_t media) {
+    if (itsFrameCount == 0 || media > itsTimestamp)
+        itsTimestamp = media;
+    else
+        itsTimestamp += USEC_PER_SEC / itsFps;
+    itsFrameCount++;
+    return itsTimestamp;
+}
+
+static inline uint64_t
+monotonic_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * USEC_PER_SEC + (uint64_t)ts.tv_nsec / 1000;
+}
+
 bool
-VideoSource::read(cv::Mat& into) {
+VideoSource::read(cv::Mat& into, uint64_t& timestamp) {
+    if (isRaw()) {
+        uint64_t recorded = 0;
+        if (!itsRawSource->read(into, recorded))
+            return false;
+        // synthesize the time of frames that were stored without one
+        timestamp = nextTimestamp(recorded ? recorded : itsFrameCount * USEC_PER_SEC / itsFps);
+        return true;
+    }
+
     if (isFile()) {
         cv::Mat tmp;
         if (!itsFileCapture.read(tmp))
             return false;
+        // some backends do not report positions, so fall back to fps
+        const double msec = itsFileCapture.get(CV_CAP_PROP_POS_MSEC);
+        timestamp = nextTimestamp(msec > 0 ? msec * 1000 : itsFrameCount * USEC_PER_SEC / itsFps);
         cv::Mat ycbcr;
         cv::cvtColor(tmp, ycbcr, cv::COLOR_RGB2YCrCb);
 
@@ -240,6 +291,12 @@ VideoSource::read(cv::Mat& into) {
     // wait until the buffer is filled, and lock it
     check_return(ioctl (itsCameraFd, VIDIOC_DQBUF, &buffer_info));
 
+    // the driver stamps buffers with the monotonic clock when they were
+    // captured, though not every driver bothers
+    const uint64_t captured = (uint64_t)buffer_info.timestamp.tv_sec * USEC_PER_SEC
+        + buffer_info.timestamp.tv_usec;
+    timestamp = nextTimestamp(captured ? captured : monotonic_us());
+
     // make a mat out of the buffer
     mmap_buffer& mmapped = itsBuffers[itsNextBuffer];
     // The buffer is Y_0 Cb_0 Y_1 Cr_1 Y_2 Cb_2 etc (Cb/Cr are subsampled)
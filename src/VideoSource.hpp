@@ -10,10 +10,13 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <linux/videodev2.h>
 #include <sys/sysmacros.h>
+#include <stdint.h>
 #include <exception>
+#include <memory>
 #include <system_error>
 
 #include <opencv2/highgui/highgui.hpp>
@@ -23,7 +26,8 @@ class mmap_buffer {
     size_t bytes;
 
 public:
-    mmap_buffer(int fd, off_t offset, size_t size);
+    mmap_buffer(int fd, off_t offset, size_t size,
+                int prot = PROT_READ | PROT_WRITE, int flags = MAP_SHARED);
     ~mmap_buffer();
     mmap_buffer(const mmap_buffer&) = delete;
     mmap_buffer(mmap_buffer&&);
@@ -33,16 +37,24 @@ public:
     void *get() { return address; }
 };
 
-// A wrapper around the V42L API (or cv::VideoCapture for file IO)
+class RawSource;
+
+// A wrapper around the V42L API (or cv::VideoCapture for file IO, or
+// RawSource for already decoded luma frames)
 class VideoSource {
     const std::string itsFileName;
     cv::VideoCapture itsFileCapture;
+    std::unique_ptr<RawSource> itsRawSource;
     int itsCameraFd;
     int itsWidth, itsHeight, itsStride, itsBufferSize;
     std::vector<mmap_buffer> itsBuffers;
     int itsNextBuffer;
     int itsCurrentBuffer;
+    double itsFps;
+    uint64_t itsFrameCount;
+    uint64_t itsTimestamp;
 
+    uint64_t nextTimestamp(uint64_t media);
     void negotiateFormat();
     void startStreaming();
 
@@ -56,6 +68,10 @@ public:
     //
     bool isCamera() const { return !isFile(); }
 
+    // Return true iff the video source is a file of raw luma frames.
+    //
+    bool isRaw() const { return bool(itsRawSource); }
+
     // Return "" or the name of the file that is the source of this.
     //
     const std::string &fileName() const { return itsFileName; }
@@ -66,19 +82,23 @@ public:
 
     // If id is negative, open the video file named fileName.
     // Otherwise open the camera identified by id.
+    // The format of a file is one of "auto", "capture", "raw" or "y4m".
     //
-    VideoSource(int id, const std::string &fileName, int fps, int width, int height);
+    VideoSource(int id, const std::string &fileName, int fps, int width, int height,
+                const std::string &format = "auto");
 
     ~VideoSource();
 
     VideoSource(const VideoSource&) = delete;
     VideoSource(VideoSource&&) = delete;
 
-    // Read the next frame into the provided matrix
+    // Read the next frame into the provided matrix, and its time in
+    // microseconds into timestamp: the capture time for a camera, and
+    // the presentation time (or frame number / fps) for a file.
     // Only the Y channel is provided, and the result is a CV_8UC1 matrix
     //
     // Returns true if more frames are available in the input source, false when done
-    bool read(cv::Mat& into);
+    bool read(cv::Mat& into, uint64_t& timestamp);
 };
 
 #endif // #ifndef VIDEO_SOURCE_H_INCLUDED
@@ -0,0 +1,79 @@
+#ifndef __WorkerPool_H_INCLUDED__
+#define __WorkerPool_H_INCLUDED__
+
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <future>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Like WorkerThread, but any number of threads take work from one queue.
+// Work is started in the order it was pushed.
+class WorkerPool {
+private:
+    std::queue<std::function<void()>> queue;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping;
+    std::vector<std::thread> threads;
+
+    void loop() {
+        while (true) {
+            std::function<void()> work;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (queue.empty() && !stopping)
+                    cv.wait(lock);
+                if (queue.empty())
+                    return;
+                work = std::move(queue.front());
+                queue.pop();
+            }
+            work();
+        }
+    }
+
+public:
+    // Start count threads, or one per core if count is 0.
+    explicit WorkerPool(unsigned count = 0) : stopping(false) {
+        if (count == 0)
+            count = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned i = 0; i < count; i++)
+            threads.emplace_back(std::mem_fn(&WorkerPool::loop), this);
+    }
+
+    // Finish the queued work, then stop.
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto &thread : threads)
+            thread.join();
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool &operator=(const WorkerPool&) = delete;
+
+    unsigned size() const { return threads.size(); }
+
+    template<typename R, typename... Params, typename... Args>
+    std::future<R> push(R (*fn) (Params...), Args&&... args) {
+        // std::function must be copyable, and packaged_task is not
+        auto work = std::make_shared<std::packaged_task<R()>>(std::bind(fn, std::forward<Args>(args)...));
+        std::future<R> fut = work->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push([work]() { (*work)(); });
+        }
+        cv.notify_one();
+        return fut;
+    }
+};
+
+#endif
@@ -1,11 +1,25 @@
 #include <fstream>
+#include <memory>
 #include <inttypes.h>
 
 #include "VideoSource.hpp"
+#include "FrameRecorder.hpp"
+#include "BatchAnalysis.hpp"
+#include "StreamRunner.hpp"
+#include "Supervisor.hpp"
 #include "MotionDetection.hpp"
 
+#include <signal.h>
+#include <string.h>
 #include <time.h>
 
+static volatile sig_atomic_t stopping = 0;
+
+static void onSignal(int)
+{
+    stopping = 1;
+}
+
 static inline void print_time(uint64_t& time, char c) {
 	struct timespec ts;
     clock_gettime(CLOCK_MONOTONIC, &ts);
@@ -30,25 +44,48 @@ static int batch(const CommandLine &cl)
     MotionDetection detector(cl);
 
     uint64_t frame_time = 0;
-    VideoSource source(cl.cameraId, cl.inFile, cl.input_fps, cl.frameWidth, cl.frameHeight);
+    VideoSource source(cl.cameraId, cl.inFile, cl.input_fps, cl.frameWidth, cl.frameHeight, cl.inFormat);
+    std::unique_ptr<FrameRecorder> recorder;
+    if (!cl.recordPath.empty())
+        recorder.reset(new FrameRecorder(cl.recordPath, cl.recordHours, cl.input_fps));
     if (cl.showTimes)
         print_time(frame_time, 'A');
+
+    // With a checkpoint, stopping (as systemd does) saves it first. The
+    // capture blocked on in the meantime is restarted rather than failing
+    // with EINTR, and the loop stops after the frame.
+    if (!cl.checkpointPath.empty()) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = onSignal;
+        action.sa_flags = SA_RESTART;
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+    }
     for (;;) {
+        if (stopping) {
+            detector.checkpoint();
+            return 0;
+        }
         // for each frame
-        cv::Mat frame; const bool more = source.read(frame);
+        cv::Mat frame; uint64_t timestamp = 0;
+        const bool more = source.read(frame, timestamp);
         if (cl.showTimes)
             print_time(frame_time, 'A');
         if (frame.empty()) {
             if (cl.showTimes)
                 print_time(frame_time, 'B');
             if (!more) {
+                detector.checkpoint();
                 //time(&end);
                 //double diff_t = difftime(end, start);
                 //printf("[info] time: %f\n", diff_t);
                 return 0;
             }
         } else {
-            detector.update(frame);
+            if (recorder)
+                recorder->record(frame, timestamp);
+            detector.update(frame, timestamp);
             if (cl.showTimes)
                 print_time(frame_time, 'B');
         }
@@ -61,6 +98,11 @@ int main(int argc, char *argv[])
         const CommandLine cl(argc, argv);
         if (cl.help || cl.about) return 0;
         if (cl.ok) {
+            if (!cl.workerRing.empty()) return runWorker(cl);
+            if (cl.supervise) return supervise(cl);
+            if (cl.benchmark) return benchmarkEngines(cl);
+            if (!cl.batchPath.empty()) return analyzeBatch(cl);
+            if (!cl.streams.empty()) return runStreams(cl);
             printf("[info] starting batch processing.\n");
             if (cl.sourceCount) return batch(cl);
         }